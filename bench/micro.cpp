@@ -0,0 +1,266 @@
+#include <Grappa.hpp>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define MICRO_TSC 1
+#endif
+
+// one byte per cell, as in life
+enum class State : uint8_t { Dead, Alive };
+
+#include "Game.hpp"
+#include "Patterns.hpp"
+#include "generate.hpp"
+#include "lloyd.hpp"
+
+DEFINE_string(kernels, "dist,closest,project,line,step", "kernels to time, any of dist, closest, project, line and step");
+DEFINE_string(sizes, "4096,262144,4194304", "elements per pass, one run of every kernel per size");
+DEFINE_int64(clusters, 16, "closest: centroids each point is compared against");
+DEFINE_int64(threads, 1, "step: threads stepping the board");
+DEFINE_int64(step_generations, 8, "step: generations each pass steps, from the same soup every time");
+DEFINE_double(min_time, 0.2, "seconds a timed run lasts at least; passes are repeated until it does");
+DEFINE_int64(repeat, 3, "timed runs per kernel and size; the best is reported");
+DEFINE_double(ghz, 0, "clock for cycles per element (0: the time-stamp counter's rate, measured)");
+DEFINE_int64(stream_mb, 256, "size of the arrays the bandwidth roof is measured on");
+DEFINE_bool(csv, false, "print CSV instead of a table");
+
+/**
+ * Times the kernels the hot loops are built from, one element at a time:
+ *
+ *   dist     one distance between two points (kmeans/Point.hpp)
+ *   closest  one point against --clusters centroids (kmeans/lloyd.hpp)
+ *   project  one cell read through Spaces::Board::get, so Domain::project
+ *   line     one cell of a line kernel, every kernel this CPU runs
+ *            (life/LineKernels.hpp; these replaced the per-cell neighbour
+ *            count, count_alive)
+ *   step     one cell update of Game::step: every pass steps
+ *            --step_generations from the same soup on a fresh square board
+ *
+ * For each it reports nanoseconds and cycles per element, the bytes per
+ * element the kernel must move to or from memory, and the roof: the cycles
+ * per element those bytes take at the machine's measured bandwidth (an
+ * a[i] = b[i] + s c[i] triad over --stream_mb). A kernel at 100% of its
+ * roof is bandwidth bound; sizes that fit in cache can beat it.
+ *
+ * Runs on the shared-memory backend on one core; no MPI is needed.
+ */
+
+volatile double sink;       // results land here, so no pass is optimized away
+
+/**
+ * Best seconds per element over --repeat runs of pass(), which handles
+ * `elements` elements. setup() runs before every pass, untimed, for
+ * passes that must all start from the same state.
+ */
+template <typename F, typename S>
+double time_per_element(long elements, F pass, S setup) {
+    auto run = [&](long passes) {
+        double t = 0;
+        for (long p = 0; p < passes; p++) {
+            setup();
+            double start = walltime();
+            pass();
+            t += walltime() - start;
+        }
+        return t;
+    };
+    long passes = 1;
+    double best = 0;
+    for (;;) {
+        double t = run(passes);
+        if (t >= FLAGS_min_time) { best = t / passes; break; }
+        passes = t > 0 ? std::max(2 * passes, (long) (passes * 1.2 * FLAGS_min_time / t)) : 2 * passes;
+    }
+    for (long r = 1; r < FLAGS_repeat; r++) best = std::min(best, run(passes) / passes);
+    return best / elements;
+}
+
+template <typename F>
+double time_per_element(long elements, F pass) {
+    return time_per_element(elements, pass, []{});
+}
+
+// Cycles per second: --ghz, or the time-stamp counter measured against the wall clock.
+double clock_rate() {
+    if (FLAGS_ghz > 0) return FLAGS_ghz * 1e9;
+#ifdef MICRO_TSC
+    double start = walltime();
+    unsigned long long c0 = __rdtsc();
+    while (walltime() - start < 0.1) {}
+    return (__rdtsc() - c0) / (walltime() - start);
+#else
+    throw std::runtime_error("no cycle counter on this CPU: give the clock with --ghz");
+#endif
+}
+
+// Bytes per second of a triad over three arrays far larger than cache.
+double stream_bandwidth() {
+    const long n = FLAGS_stream_mb * (1L << 20) / (3 * sizeof(double));
+    std::vector<double> a(n, 0), b(n, 1), c(n, 2);
+    double seconds = time_per_element(n, [&] {
+        for (long i = 0; i < n; i++) a[i] = b[i] + 0.5 * c[i];
+        sink = a[n / 2];
+    });
+    return 3 * sizeof(double) / seconds;
+}
+
+struct Row {
+    std::string kernel;
+    long size;
+    double seconds;     // per element
+    double bytes;       // per element
+};
+
+void print(const std::vector<Row>& rows, double hz, double bandwidth) {
+    if (FLAGS_csv) {
+        std::cout << "kernel,size,ns_per_element,cycles_per_element,bytes_per_element,roof_cycles_per_element,roof_share\n";
+    } else {
+        printf("clock %.3f GHz, bandwidth roof %.2f GB/s (%.2f bytes/cycle)\n\n",
+               hz / 1e9, bandwidth / 1e9, bandwidth / hz);
+        printf("%-22s %10s %10s %10s %10s %10s %8s\n",
+               "kernel", "size", "ns/elem", "cyc/elem", "B/elem", "roof cyc", "of roof");
+    }
+    for (const Row& r : rows) {
+        double cycles = r.seconds * hz;
+        double roof = r.bytes / bandwidth * hz;
+        if (FLAGS_csv)
+            printf("%s,%ld,%.4f,%.4f,%.1f,%.4f,%.3f\n", r.kernel.c_str(), r.size,
+                   r.seconds * 1e9, cycles, r.bytes, roof, roof / cycles);
+        else
+            printf("%-22s %10ld %10.3f %10.3f %10.1f %10.3f %7.1f%%\n", r.kernel.c_str(), r.size,
+                   r.seconds * 1e9, cycles, r.bytes, roof, 100 * roof / cycles);
+    }
+}
+
+std::vector<std::string> split(const std::string& list) {
+    std::vector<std::string> out;
+    std::stringstream in(list);
+    for (std::string item; std::getline(in, item, ','); )
+        if (!item.empty()) out.push_back(item);
+    return out;
+}
+
+std::vector<Point> random_points(long n, uint64_t seed) {
+    std::vector<Point> points(n);
+    for (long k = 0; k < n; k++)
+        points[k] = Point(100 * unit(mix64(seed + 2 * k)), 100 * unit(mix64(seed + 2 * k + 1)));
+    return points;
+}
+
+void bench_dist(long n, std::vector<Row>& rows) {
+    std::vector<Point> a = random_points(n, 1), b = random_points(n, 2);
+    double t = time_per_element(n, [&] {
+        double sum = 0;
+        for (long k = 0; k < n; k++) sum += dist(a[k], b[k]);
+        sink = sum;
+    });
+    rows.push_back(Row{ "dist", n, t, 2 * sizeof(Point) });
+}
+
+void bench_closest(long n, std::vector<Row>& rows) {
+    std::vector<Point> points = random_points(n, 3), centroids = random_points(FLAGS_clusters, 4);
+    double t = time_per_element(n, [&] {
+        long sum = 0;
+        for (long k = 0; k < n; k++) sum += closest(points[k], centroids.data(), FLAGS_clusters);
+        sink = sum;
+    });
+    rows.push_back(Row{ "closest k=" + std::to_string(FLAGS_clusters), n, t, sizeof(Point) });
+}
+
+// A square board of about n cells, soup inside.
+long side_of(long n) { return std::max(8L, (long) std::sqrt((double) n)); }
+
+void bench_project(long n, std::vector<Row>& rows) {
+    const long side = side_of(n);
+    Spaces::Board<State> board(Spaces::Domain(Spaces::Range(side + 2), Spaces::Range(side + 2)));
+    for (long j = 1; j <= side; j++)
+        for (long i = 1; i <= side; i++)
+            if (soup_alive(1, i, j, 0.5)) board.get(i, j) = State::Alive;
+    double t = time_per_element(side * side, [&] {
+        long alive = 0;
+        for (long j = 1; j <= side; j++)
+            for (long i = 1; i <= side; i++) alive += (long) board.get(i, j);
+        sink = alive;
+    });
+    rows.push_back(Row{ "project", side * side, t, sizeof(State) });
+}
+
+void bench_lines(long n, std::vector<Row>& rows) {
+    const long cols = std::min(n, 4096L), lines = std::max(1L, n / cols);
+    const Rule rule;
+    std::vector<uint8_t> now((lines + 2) * (cols + 2), 0), next(now.size(), 0);
+    for (long l = 1; l <= lines; l++)
+        for (long c = 1; c <= cols; c++) now[l * (cols + 2) + c] = soup_alive(2, l, c, 0.5);
+
+    std::vector<std::pair<std::string, LineKernel>> kernels;
+    kernels.push_back(std::make_pair(std::string("scalar"), step_line_scalar));
+    for (const char* wanted : { "scalar", "avx2", "avx512" }) {
+        std::string name;
+        LineKernel k = select_line_kernel(wanted, rule, &name);
+        bool seen = false;
+        for (auto& e : kernels) seen = seen || e.first == name;
+        if (!seen) kernels.push_back(std::make_pair(name, k));
+    }
+
+    for (auto& e : kernels) {
+        LineKernel kernel = e.second;
+        double t = time_per_element(lines * cols, [&] {
+            for (long l = 1; l <= lines; l++) {
+                const uint8_t* mid = &now[l * (cols + 2)];
+                kernel(mid - (cols + 2), mid, mid + (cols + 2), &next[l * (cols + 2)], 1, cols + 1, rule);
+            }
+            sink = next[next.size() / 2];
+        });
+        rows.push_back(Row{ "line " + e.first, lines * cols, t, 2 });
+    }
+}
+
+// A soup left to evolve thins out and settles, and quiet tiles are skipped: every pass starts over.
+void bench_step(long n, std::vector<Row>& rows) {
+    const long side = side_of(n), gens = FLAGS_step_generations;
+    if (gens < 1) throw std::runtime_error("--step_generations must be positive");
+    std::unique_ptr<Game> game;
+    double t = time_per_element(side * side * gens, [&] { game->step(gens); }, [&] {
+        game.reset();
+        game.reset(new Game(side, side, FLAGS_threads));
+        place_soup(*game, side, side, 0.5, 3);
+    });
+    rows.push_back(Row{ "Game::step t=" + std::to_string(FLAGS_threads), side * side, t, 2 });
+}
+
+void main_body() {
+    double hz = clock_rate();
+    double bandwidth = stream_bandwidth();
+
+    std::vector<Row> rows;
+    for (const std::string& size : split(FLAGS_sizes)) {
+        long n = std::stol(size);
+        if (n < 1) throw std::runtime_error("sizes must be positive: " + size);
+        for (const std::string& kernel : split(FLAGS_kernels)) {
+            if      (kernel == "dist")    bench_dist(n, rows);
+            else if (kernel == "closest") bench_closest(n, rows);
+            else if (kernel == "project") bench_project(n, rows);
+            else if (kernel == "line")    bench_lines(n, rows);
+            else if (kernel == "step")    bench_step(n, rows);
+            else throw std::runtime_error("unknown kernel " + kernel);
+        }
+    }
+    print(rows, hz, bandwidth);
+}
+
+int main(int argc, char* argv[])
+{
+    Grappa::init(&argc, &argv);
+    Grappa::run([]{
+        main_body();
+    });
+    Grappa::finalize();
+    return 0;
+}
@@ -0,0 +1,107 @@
+#!/bin/bash
+# Strong and weak scaling of life-parallel, life and kmeans on this host.
+#
+#   bench/scaling.sh [report.csv]
+#
+# Builds the programs, runs each over every core count in CORES and every
+# size in the size lists, and writes one CSV row per run (default
+# bench/scaling.csv):
+#
+#   app,mode,backend,cores,size,per_core,seconds,throughput,unit,efficiency
+#
+# Strong scaling keeps the problem fixed: size is the board side for the
+# life programs and the number of points for kmeans. Weak scaling keeps the
+# work per core fixed: the board is side x (side * cores), kmeans clusters
+# points * cores points. throughput is cell updates/s or point-iterations/s;
+# efficiency is throughput per core relative to the first core count of the
+# same app, mode and size, so CORES normally starts at 1.
+#
+# BACKEND=grappa (default) runs each program as `$MPIRUN -np <cores>`, so
+# several MPI ranks on localhost; BACKEND=shm runs one process with
+# --shm_cores=<cores>. life steps with --threads=<cores> in one process
+# either way. Everything below can be set in the environment.
+set -e
+
+BACKEND=${BACKEND:-grappa}
+MPIRUN=${MPIRUN:-mpirun}
+CORES=${CORES:-"1 2 4 8"}
+MODES=${MODES:-"strong weak"}
+LIFE_SIZES=${LIFE_SIZES:-"1024 4096"}
+LIFE_GENERATIONS=${LIFE_GENERATIONS:-100}
+LIFE_BLOCK=${LIFE_BLOCK:-256}
+LIFE_SOUP=${LIFE_SOUP:-0.5}         # live share of the random starting board, which covers it all
+KMEANS_POINTS=${KMEANS_POINTS:-"1000000 4000000"}
+KMEANS_CLUSTERS=${KMEANS_CLUSTERS:-16}
+KMEANS_ITERATIONS=${KMEANS_ITERATIONS:-10}
+REPEAT=${REPEAT:-3}
+
+ROOT=$(cd "$(dirname "$0")/.." && pwd)
+REPORT=${1:-$ROOT/bench/scaling.csv}
+
+# -B: never time binaries left over from a build for the other backend
+# (kmeans/make.sh compiles unconditionally)
+(cd "$ROOT/life" && BACKEND=$BACKEND bash make.sh -B all)
+(cd "$ROOT/kmeans" && BACKEND=$BACKEND bash make.sh)
+
+# launch <cores> <program> <args...>
+launch() {
+    local p=$1; shift
+    if [ "$BACKEND" = shm ]; then
+        "$@" --shm_cores="$p"
+    else
+        $MPIRUN -np "$p" "$@"
+    fi
+}
+
+# the number just before <unit> in the program's output
+field() {
+    sed -n "s|.*[ :] *\([0-9][0-9.e+-]*\) *$1.*|\1|p" | tail -1
+}
+
+# run <app> <cores> <size>: prints "seconds throughput", the best of REPEAT runs
+run() {
+    local app=$1 p=$2 size=$3 out best_s= best_t=0
+    for r in $(seq "$REPEAT"); do
+        case $app in
+        life-parallel)
+            out=$(launch "$p" "$ROOT/life/life-parallel" --headless --height="${size%x*}" --width="${size#*x}" \
+                  --generations="$LIFE_GENERATIONS" --block="$LIFE_BLOCK" --soup="$LIFE_SOUP")
+            s=$(echo "$out" | field " s,"); t=$(echo "$out" | field "cell updates/s") ;;
+        life)
+            out=$(launch 1 "$ROOT/life/life" --headless --engine=cells --threads="$p" --height="${size%x*}" \
+                  --width="${size#*x}" --generations="$LIFE_GENERATIONS" --soup="$LIFE_SOUP")
+            s=$(echo "$out" | field " s,"); t=$(echo "$out" | field "cell updates/s") ;;
+        kmeans)
+            out=$(cd "$ROOT/kmeans" && launch "$p" ./KMeans --generate --points="$size" --clusters="$KMEANS_CLUSTERS" \
+                  --iterations="$KMEANS_ITERATIONS" --repetitions=1)
+            s=$(echo "$out" | grep "elapsed time" | field s); t=$(echo "$out" | field "point-iterations/s") ;;
+        esac
+        [ -n "$t" ] || { echo "no throughput from $app on $p cores:" >&2; echo "$out" >&2; exit 1; }
+        if awk "BEGIN { exit !($t > $best_t) }"; then best_s=$s; best_t=$t; fi
+    done
+    echo "$best_s $best_t"
+}
+
+echo "app,mode,backend,cores,size,per_core,seconds,throughput,unit,efficiency" > "$REPORT"
+for app in life-parallel life kmeans; do
+    if [ $app = kmeans ]; then sizes=$KMEANS_POINTS; unit=point-iterations/s; else sizes=$LIFE_SIZES; unit=cell-updates/s; fi
+    for mode in $MODES; do
+        for base in $sizes; do
+            ref=
+            for p in $CORES; do
+                if [ $app = kmeans ]; then
+                    size=$base; [ $mode = weak ] && size=$((base * p))
+                    per_core=$((size / p))
+                else
+                    size=${base}x$base; [ $mode = weak ] && size=${base}x$((base * p))
+                    [ $mode = weak ] && per_core=$((base * base)) || per_core=$((base * base / p))
+                fi
+                read s t < <(run $app "$p" "$size")
+                [ -n "$ref" ] || ref=$(awk "BEGIN { print $t / $p }")
+                eff=$(awk "BEGIN { printf \"%.3f\", $t / $p / $ref }")
+                echo "$app,$mode,$BACKEND,$p,$size,$per_core,$s,$t,$unit,$eff" | tee -a "$REPORT"
+            done
+        done
+    done
+done
+echo "report: $REPORT"
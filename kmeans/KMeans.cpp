@@ -1,195 +1,166 @@
 #include <Grappa.hpp>
-#include <GlobalVector.hpp>
-#include <GlobalHashMap.hpp>
-#include <GlobalHashSet.hpp>
 #include <limits>
 #include <cassert>
 #include <chrono>
+#include <stdexcept>
+#include <string>
 
 #include "KMeans.hpp"
 
-typedef GlobalAddress<int> GInt;
 using namespace Grappa;
 
-void reset_centroids(GPoint _points, GPoint _centroids, size_t num_points, size_t num_centroids) {
-    for(int i = 0; i < num_centroids; i++){
-        Point p = delegate::read(_points+i);
-        delegate::write(_centroids+i, p);
+DEFINE_int64(points, 10000, "number of points to cluster");
+DEFINE_int64(clusters, 10, "number of clusters");
+DEFINE_int64(iterations, 15, "rounds of Lloyd's algorithm per clustering");
+DEFINE_int64(repetitions, 2, "times the clustering is repeated; the reported time is the mean");
+DEFINE_string(points_file, "../points.json", "JSON array of [x, y] pairs to read the points from");
+DEFINE_bool(generate, false, "cluster --points synthetic points around --clusters centres instead of reading --points_file");
+DEFINE_int64(seed, 1, "seed for --generate");
+DEFINE_string(output, "", "if set, write labels to <output>.labels and centroids to <output>.centroids.{bin,txt}");
+DEFINE_int64(incremental_batch, 0, "if > 0, stream the points in batches of this size through the incremental clusterer");
+DEFINE_double(drift_threshold, 1.0, "incremental mode: re-cluster everything once a centroid moved this far");
+DEFINE_bool(bisecting, false, "build the clusters by repeated 2-means splits instead of flat kmeans");
+DEFINE_string(bisect_by, "sse", "bisecting mode: split the leaf with the highest 'sse' or the most points ('size')");
+
+// Replays the points as a stream of appends through IncrementalKMeans.
+template <typename Label>
+void run_incremental(GPoint gpoints, int64_t num_points, int num_clusters, int niters) {
+    int64_t batch_size = std::max<int64_t>(FLAGS_incremental_batch, num_clusters);
+    IncrementalKMeans<Label> online(num_clusters, niters, FLAGS_drift_threshold, batch_size);
+    Point* batch = new Point[batch_size];
+
+    auto start = std::chrono::system_clock::now();
+    for (int64_t first = 0; first < num_points; first += batch_size) {
+        int64_t n = std::min(batch_size, num_points - first);
+        forall_here(0, n, [=](int64_t i) { batch[i] = delegate::read(gpoints + first + i); });
+        online.add(batch, n);
     }
-}
-
-void reset_clusters(GInt _clusters, size_t num_points) {
-    for(int i = 0; i < num_points; i++){
-        delegate::write(_clusters+i, 0);
-    }
-}
-
+    std::chrono::duration<double> elapsed = std::chrono::system_clock::now() - start;
 
+    std::cout << "incremental: " << online.store.size << " points, "
+              << online.reclusters << " full re-clusterings, "
+              << "elapsed time: " << elapsed.count() << "s\n";
 
-int closest(Point point, Point* centroids, int num_centroids)
-{
-    int _closest=0;
-    double min_d=dist(point,centroids[0]);
-    
-    for(int i=1;i<num_centroids;i++)
-    {   
-        int d = dist(point,centroids[i]);
-        if(min_d >= d)
-        {
-            _closest=i;
-            min_d=d;
-        }
+    if (!FLAGS_output.empty()) {
+        write_labels(FLAGS_output + ".labels", online.store.clusters, online.store.size);
+        write_centroids(FLAGS_output + ".centroids", online.centroids, num_clusters);
     }
-    return _closest;
+    delete [] batch;
 }
 
-void update_centroids(GPoint points, GInt clusters, GPoint centroids, int num_clusters, int num_points)
-{
-
-    DVLOG(3) << "update_centroids";
-    Point new_centroids[num_clusters];
-    int   population[num_clusters];
-
-    // for all cluster assignments
-    // count the points in that cluster 
-    // forall_here(0, num_clusters, [=](int64_t i) {
-    //     int k = delegate::read(clusters + i);
-    //     population[k]++;
+template <typename Label>
+void run_bisecting(GPoint gpoints, int64_t num_points, int num_clusters, int niters) {
+    auto start = std::chrono::system_clock::now();
 
-    //     Point p = delegate::read(points+i);
-    //     new_centroids[k] += p;
+    BisectingKMeans<Label> bisecting(gpoints, num_points, niters, FLAGS_bisect_by == "sse");
+    bisecting.run(num_clusters);
 
-    // });
-    // forall_here(0, num_clusters, [=](int64_t i) {
-    //     if(population[i] != 0)
-    //         new_centroids[i] /= population[i];
-    // });
-    // forall_here(0, num_clusters, [=](int64_t i) {
-    //     delegate::write(centroids+i, new_centroids[i]);
-    // });
-
-    for(int64_t i = 0; i < num_clusters; i++) {
-        int k = delegate::read(clusters + i);
-        population[k]++;
-
-        Point p = delegate::read(points + i);
-        new_centroids[k] += p;
-
-    };
-
-    DVLOG(3) << "counters updated";
-
-    for(int64_t i = 0; i < num_clusters; i++) {
-        if(population[i] != 0)
-            new_centroids[i] /= population[i];
-    };
-    for(int64_t i = 0; i < num_clusters; i++) {
-        delegate::write(centroids+i, new_centroids[i]);
-    };
-
-
-    DVLOG(3) << "centroids updated";
+    GLabels<Label> gclusters  = global_alloc<Label>(num_points);
+    GPoint         gcentroids = global_alloc<Point>(num_clusters);
+    int nleaves = bisecting.assign_labels(gclusters, gcentroids);
 
+    std::chrono::duration<double> elapsed = std::chrono::system_clock::now() - start;
+    std::cout << "bisecting: " << nleaves << " clusters, " << bisecting.tree.size() << " tree nodes, "
+              << "elapsed time: " << elapsed.count() << "s\n";
 
+    if (!FLAGS_output.empty()) {
+        write_labels(FLAGS_output + ".labels", gclusters, num_points);
+        write_centroids(FLAGS_output + ".centroids", gcentroids, nleaves);
+        bisecting.write_tree(FLAGS_output + ".tree");
+    }
+    global_free(gclusters);
+    global_free(gcentroids);
 }
 
-void main_body() {
+template <typename Label>
+void cluster(GPoint gpoints, int64_t num_points, int num_clusters, int niters, int repetitions) {
 
+    DVLOG(1) << "labels are " << sizeof(Label) << " byte(s) wide";
 
-    int repetitions = 2;
-    
-    int num_clusters = 10;
-    int num_points   = 10000;
-    int niters = 15;
+    if (FLAGS_incremental_batch > 0) {
+        run_incremental<Label>(gpoints, num_points, num_clusters, niters);
+        return;
+    }
+    if (FLAGS_bisecting) {
+        run_bisecting<Label>(gpoints, num_points, num_clusters, niters);
+        return;
+    }
 
+    GPoint         gcentroids = global_alloc<Point>(num_clusters);
+    GLabels<Label> gclusters  = global_alloc<Label>(num_points);
+    GPoint         gsums      = global_alloc<Point>(num_clusters);
+    GCount         gcounts    = global_alloc<int64_t>(num_clusters);
 
-    int job_size = num_points / Grappa::cores();
-    
     std::chrono::time_point<std::chrono::system_clock> start, end;
-    std::chrono::duration<double> elapsed_seconds;
-        
-    Grappa::run([=] {  
-
-        GPoint gcentroids = global_alloc<Point>(num_clusters);
-        GPoint gpoints    = global_alloc<Point>(num_points);
-        GInt   gclusters  = global_alloc<int>(num_points);
-        
-        read_points(gpoints, num_points);
-
-
-        for (int t = 0; t < repetitions; t++) {
-            reset_centroids(gpoints, gcentroids, num_points, num_clusters);
-            reset_clusters(gclusters, num_points);
-
-            start = std::chrono::system_clock::now();
+    std::chrono::duration<double> elapsed_seconds(0);
 
+    for (int t = 0; t < repetitions; t++) {
+        reset_centroids(gpoints, gcentroids, num_points, num_clusters);
+        reset_clusters(gclusters, num_points);
 
-            DVLOG(3) << "points read. begin.";
-            
-            //Main job of master processor is done here     
-            for(int iter = 0; iter < niters; iter++)
-            {   
-                DVLOG(3) << "iter " << iter;
+        start = std::chrono::system_clock::now();
 
-                on_all_cores([=]{
 
-                    int64_t my_offset = job_size * Grappa::mycore();
-                    int64_t my_job_size = job_size;
+        DVLOG(3) << "points read. begin.";
 
-                    if (Grappa::mycore() == Grappa::cores() - 1)
-                        my_job_size += num_points % Grappa::cores();
+        lloyd(gpoints, gclusters, gcentroids, num_clusters, num_points, gsums, gcounts, niters);
 
-                    // double decl to work-around C++ capture behavior w/ array refs
+        end = std::chrono::system_clock::now();
+        elapsed_seconds += ( end-start );
 
-                    Point _points[my_job_size];
-                    Point* points = _points;
-                    
-                    Point _centroids[num_clusters];
-                    Point* centroids = _centroids;
-
-                    DVLOG(3) << "fetch centroids " << my_job_size;
-
-                
-                    // fetch points from gmemory
-                    forall_here(0, num_clusters, [=](int64_t i) {
-                        centroids[i] = delegate::read(gcentroids+i);
-                    });
+    }
 
-                    DVLOG(3) << "fetch points " << my_job_size;
 
-                
-                    forall_here(0, my_job_size, [=](int64_t i) {
-                        points[i] = delegate::read(gpoints + my_offset + i);
-                    });
+    std::time_t end_time = std::chrono::system_clock::to_time_t(end);
 
-                    DVLOG(3) << "points were fetched. start";
+    double seconds = elapsed_seconds.count() / (double) repetitions;
+    std::cout << "finished computation at " << std::ctime(&end_time)
+              << "elapsed time: " << seconds << "s\n"
+              << num_points << " points, " << num_clusters << " clusters, " << niters << " iterations on "
+              << cores() << " cores: " << (double) num_points * niters / seconds << " point-iterations/s\n";
 
-                    // compute & write back gclusters to gmemory
-                    forall_here(my_offset, my_job_size, [=](int64_t j) {
-                        delegate::write(gclusters + j, my_offset + closest(points[j], centroids, num_clusters));
-                    });
-                    DVLOG(3) << "finished work.";
+    if (!FLAGS_output.empty()) {
+        write_labels(FLAGS_output + ".labels", gclusters, num_points);
+        write_centroids(FLAGS_output + ".centroids", gcentroids, num_clusters);
+        std::cout << "wrote " << FLAGS_output << ".labels, " << FLAGS_output << ".centroids.{bin,txt}\n";
+    }
+}
 
+void main_body() {
 
-                });
-                
-                update_centroids(gpoints, gclusters, gcentroids, num_clusters, num_points);
+    // every clustering seeds its centroids with the first --clusters points
+    if (FLAGS_clusters < 1 || FLAGS_clusters > std::numeric_limits<int>::max())
+        throw std::runtime_error("--clusters must be between 1 and " + std::to_string(std::numeric_limits<int>::max()));
+    if (FLAGS_points < FLAGS_clusters)
+        throw std::runtime_error("--points (" + std::to_string(FLAGS_points) + ") must be at least --clusters (" +
+                                 std::to_string(FLAGS_clusters) + ")");
+    if (FLAGS_iterations < 1 || FLAGS_repetitions < 1)
+        throw std::runtime_error("--iterations and --repetitions must be at least 1");
 
-            }
+    int repetitions  = FLAGS_repetitions;
+    
+    int num_clusters = FLAGS_clusters;
+    int64_t num_points = FLAGS_points;
+    int niters       = FLAGS_iterations;
 
-            end = std::chrono::system_clock::now();
-            elapsed_seconds += ( end-start );
 
-        }
+    Grappa::run([=] {  
 
+        GPoint gpoints    = global_alloc<Point>(num_points);
 
-        std::time_t end_time = std::chrono::system_clock::to_time_t(end);
-     
-        std::cout << "finished computation at " << std::ctime(&end_time)
-                  << "elapsed time: " << elapsed_seconds.count() / (double) repetitions << "s\n";
+        if (FLAGS_generate)
+            generate_points(gpoints, num_points, num_clusters, FLAGS_seed);
+        else
+            read_points(gpoints, num_points, FLAGS_points_file);
 
+        // labels are stored at the narrowest width that can hold every cluster id
+        if (num_clusters <= (1 << 8))
+            cluster<uint8_t>(gpoints, num_points, num_clusters, niters, repetitions);
+        else if (num_clusters <= (1 << 16))
+            cluster<uint16_t>(gpoints, num_points, num_clusters, niters, repetitions);
+        else
+            cluster<uint32_t>(gpoints, num_points, num_clusters, niters, repetitions);
 
-        
     });
 }
 
@@ -4,6 +4,12 @@
 #include "Point.hpp"
 #include "PointList.hpp"
 
+#include "lloyd.hpp"
+#include "incremental.hpp"
+#include "bisecting.hpp"
+
 #include "from_json.hpp"
+#include "generate.hpp"
+#include "to_file.hpp"
 
 
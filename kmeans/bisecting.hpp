@@ -0,0 +1,305 @@
+#pragma once
+
+#include <Grappa.hpp>
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <queue>
+#include <stdexcept>
+#include <vector>
+
+#include "Point.hpp"
+#include "lloyd.hpp"
+#include "slice.hpp"
+
+
+using namespace Grappa;
+
+typedef GlobalAddress<int64_t> GIndex;
+
+/**
+ * A node of the bisecting kmeans tree. The points it covers are the
+ * contiguous range [begin, end) of the permuted point array.
+ */
+struct ClusterNode {
+    Point   centroid;
+    double  sse = 0;
+    int64_t begin = 0, end = 0;
+    int     left = -1, right = -1;   // children; -1 for a leaf
+    int     label = -1;              // final cluster id, leaves only
+
+    int64_t size() const { return end - begin; }
+    bool is_leaf() const { return left < 0; }
+};
+
+// Sum of squared distances of points [first, first + n) to `centroid`.
+double range_sse(GPoint points, int64_t first, int64_t n, Point centroid) {
+    GlobalAddress<double> result = global_alloc<double>(1);
+    on_all_cores([=]{
+        Slice mine = core_slice(n);
+        Point* local = new Point[mine.size];
+        forall_here(0, mine.size, [=](int64_t i) {
+            local[i] = delegate::read(points + first + mine.offset + i);
+        });
+        double sse = 0;
+        for (int64_t i = 0; i < mine.size; i++) sse += sq(dist(local[i], centroid));
+        delete [] local;
+
+        double total = allreduce<double, collective_add<double>>(sse);
+        if (mycore() == 0) delegate::write(result, total);
+    });
+    double sse = delegate::read(result);
+    global_free(result);
+    return sse;
+}
+
+/**
+ * Stable parallel partition of [first, first + n) by `sides` (0 goes left,
+ * 1 goes right), carrying the original ids along. Every core counts its
+ * left-going points, the master turns the counts into per-core offsets, and
+ * each core then scatters its slice into the scratch arrays, which are
+ * copied back over the range.
+ */
+void partition_range(GPoint points, GIndex ids, GLabels<uint8_t> sides,
+                     GPoint scratch, GIndex scratch_ids, GIndex partials,
+                     int64_t first, int64_t n, int64_t nleft)
+{
+    on_all_cores([=]{
+        Slice mine = core_slice(n);
+        uint8_t* side = new uint8_t[mine.size];
+        forall_here(0, mine.size, [=](int64_t i) {
+            side[i] = delegate::read(sides + first + mine.offset + i);
+        });
+        int64_t lefts = std::count(side, side + mine.size, 0);
+        delegate::write(partials + mycore(), lefts);
+        delete [] side;
+    });
+
+    int64_t prefix = 0;
+    for (Core c = 0; c < cores(); c++) {
+        int64_t lefts = delegate::read(partials + c);
+        delegate::write(partials + c, prefix);
+        prefix += lefts;
+    }
+
+    on_all_cores([=]{
+        Slice mine = core_slice(n);
+        uint8_t* side    = new uint8_t[mine.size];
+        Point*   local   = new Point[mine.size];
+        int64_t* id      = new int64_t[mine.size];
+        int64_t* dest    = new int64_t[mine.size];
+        forall_here(0, mine.size, [=](int64_t i) {
+            side[i]  = delegate::read(sides  + first + mine.offset + i);
+            local[i] = delegate::read(points + first + mine.offset + i);
+            id[i]    = delegate::read(ids    + first + mine.offset + i);
+        });
+
+        int64_t lefts_before = delegate::read(partials + mycore());
+        int64_t l = first + lefts_before;
+        int64_t r = first + nleft + (mine.offset - lefts_before);
+        for (int64_t i = 0; i < mine.size; i++)
+            dest[i] = side[i] == 0 ? l++ : r++;
+
+        forall_here(0, mine.size, [=](int64_t i) {
+            delegate::write(scratch + dest[i], local[i]);
+            delegate::write(scratch_ids + dest[i], id[i]);
+        });
+
+        delete [] side;
+        delete [] local;
+        delete [] id;
+        delete [] dest;
+    });
+
+    forall(points + first, n, [scratch, first](int64_t i, Point& p) {
+        p = delegate::read(scratch + first + i);
+    });
+    forall(ids + first, n, [scratch_ids, first](int64_t i, int64_t& id) {
+        id = delegate::read(scratch_ids + first + i);
+    });
+}
+
+/**
+ * Bisecting (divisive hierarchical) kmeans: starting from one cluster, the
+ * leaf with the highest SSE (or the most points) is split with 2-means
+ * until there are `num_clusters` leaves. Each split runs in parallel over
+ * only that cluster's points, so the total cost is about O(N log k) rather
+ * than O(N k) per pass, and the resulting tree gives O(log k) lookups.
+ */
+template <typename Label>
+struct BisectingKMeans {
+    int64_t num_points;
+    int     niters;
+    bool    by_sse;
+
+    GPoint           points;        // permuted so every node is a contiguous range
+    GIndex           ids;           // original index of every permuted point
+    GPoint           scratch;
+    GIndex           scratch_ids;
+    GLabels<uint8_t> sides;         // 2-means labels of the range being split
+    GPoint           pair, pair_sums;
+    GCount           pair_counts;
+    GIndex           partials;      // one slot per core for partition_range
+
+    std::vector<ClusterNode> tree;
+
+    BisectingKMeans(GPoint gpoints, int64_t num_points_, int niters_, bool by_sse_) :
+        num_points(num_points_),
+        niters(niters_),
+        by_sse(by_sse_),
+        points(global_alloc<Point>(num_points_)),
+        ids(global_alloc<int64_t>(num_points_)),
+        scratch(global_alloc<Point>(num_points_)),
+        scratch_ids(global_alloc<int64_t>(num_points_)),
+        sides(global_alloc<uint8_t>(num_points_)),
+        pair(global_alloc<Point>(2)),
+        pair_sums(global_alloc<Point>(2)),
+        pair_counts(global_alloc<int64_t>(2)),
+        partials(global_alloc<int64_t>(cores()))
+    {
+        forall(points, num_points, [gpoints](int64_t i, Point& p) { p = delegate::read(gpoints + i); });
+        forall(ids, num_points, [](int64_t i, int64_t& id) { id = i; });
+
+        // the root centroid is the mean: a one-cluster assignment pass computes it
+        ClusterNode root;
+        root.begin = 0;
+        root.end = num_points;
+        reset_sums(pair_sums, pair_counts, 1);
+        assign_clusters(points, sides, pair, 1, 0, num_points, pair_sums, pair_counts);
+        root.centroid = delegate::read(pair_sums) / num_points;
+        root.sse = range_sse(points, 0, num_points, root.centroid);
+        tree.push_back(root);
+    }
+
+    ~BisectingKMeans() {
+        global_free(points);
+        global_free(ids);
+        global_free(scratch);
+        global_free(scratch_ids);
+        global_free(sides);
+        global_free(pair);
+        global_free(pair_sums);
+        global_free(pair_counts);
+        global_free(partials);
+    }
+
+    double priority(const ClusterNode& n) const { return by_sse ? n.sse : (double) n.size(); }
+
+    // Splits leaf `idx` in two with 2-means; false if it cannot be split.
+    bool split(int idx) {
+        ClusterNode n = tree[idx];
+        if (n.size() < 2) return false;
+
+        delegate::write(pair,     delegate::read(points + n.begin));
+        delegate::write(pair + 1, delegate::read(points + n.begin + n.size() / 2));
+
+        for (int iter = 0; iter < niters; iter++) {
+            reset_sums(pair_sums, pair_counts, 2);
+            assign_clusters(points, sides, pair, 2, n.begin, n.size(), pair_sums, pair_counts);
+            update_centroids(pair, pair_sums, pair_counts, 2);
+        }
+
+        int64_t nleft = delegate::read(pair_counts);
+        if (nleft == 0 || nleft == n.size()) return false;
+
+        partition_range(points, ids, sides, scratch, scratch_ids, partials, n.begin, n.size(), nleft);
+
+        ClusterNode left, right;
+        left.begin  = n.begin;          left.end  = n.begin + nleft;
+        right.begin = n.begin + nleft;  right.end = n.end;
+        left.centroid  = delegate::read(pair);
+        right.centroid = delegate::read(pair + 1);
+        left.sse  = range_sse(points, left.begin,  left.size(),  left.centroid);
+        right.sse = range_sse(points, right.begin, right.size(), right.centroid);
+
+        tree[idx].left  = tree.size();   tree.push_back(left);
+        tree[idx].right = tree.size();   tree.push_back(right);
+        return true;
+    }
+
+    // Grows the tree to `num_clusters` leaves (fewer if no leaf can be split).
+    void run(int num_clusters) {
+        typedef std::pair<double, int> Entry;
+        std::priority_queue<Entry> leaves;
+        leaves.push(Entry(priority(tree[0]), 0));
+        int nleaves = 1;
+
+        while (nleaves < num_clusters && !leaves.empty()) {
+            int idx = leaves.top().second;
+            leaves.pop();
+            if (!split(idx)) continue;   // stays a leaf, never retried
+            int l = tree[idx].left, r = tree[idx].right;
+            leaves.push(Entry(priority(tree[l]), l));
+            leaves.push(Entry(priority(tree[r]), r));
+            nleaves++;
+            DVLOG(2) << "split " << idx << " (" << tree[idx].size() << " points) into "
+                     << tree[l].size() << " + " << tree[r].size();
+        }
+    }
+
+    /**
+     * Numbers the leaves in point order and scatters their labels back to
+     * the original point order; leaf centroids go to `centroids[label]`.
+     * Returns the number of leaves.
+     */
+    int assign_labels(GLabels<Label> clusters, GPoint centroids) {
+        std::vector<int> leaves;
+        for (int i = 0; i < (int) tree.size(); i++)
+            if (tree[i].is_leaf()) leaves.push_back(i);
+        std::sort(leaves.begin(), leaves.end(), [this](int a, int b) {
+            return tree[a].begin < tree[b].begin;
+        });
+
+        int nleaves = leaves.size();
+        GIndex bounds = global_alloc<int64_t>(nleaves);
+        for (int l = 0; l < nleaves; l++) {
+            tree[leaves[l]].label = l;
+            delegate::write(bounds + l, tree[leaves[l]].begin);
+            delegate::write(centroids + l, tree[leaves[l]].centroid);
+        }
+
+        GIndex ids = this->ids;
+        int64_t n = num_points;
+        on_all_cores([=]{
+            Slice mine = core_slice(n);
+            int64_t* begins = new int64_t[nleaves];
+            int64_t* id     = new int64_t[mine.size];
+            forall_here(0, nleaves, [=](int64_t l) { begins[l] = delegate::read(bounds + l); });
+            forall_here(0, mine.size, [=](int64_t i) { id[i] = delegate::read(ids + mine.offset + i); });
+
+            forall_here(0, mine.size, [=](int64_t i) {
+                int64_t pos = mine.offset + i;
+                Label label = std::upper_bound(begins, begins + nleaves, pos) - begins - 1;
+                delegate::write(clusters + id[i], label);
+            });
+            delete [] begins;
+            delete [] id;
+        });
+
+        global_free(bounds);
+        return nleaves;
+    }
+
+    // Label of the leaf whose centroid a descent by nearest child ends in.
+    int lookup(Point p) const {
+        int i = 0;
+        while (!tree[i].is_leaf()) {
+            const ClusterNode& l = tree[tree[i].left];
+            const ClusterNode& r = tree[tree[i].right];
+            i = dist(p, l.centroid) <= dist(p, r.centroid) ? tree[i].left : tree[i].right;
+        }
+        return tree[i].label;
+    }
+
+    // One node per line: id left right label size sse x y
+    void write_tree(const std::string& path) const {
+        std::ofstream out(path);
+        out << std::setprecision(17);
+        for (int i = 0; i < (int) tree.size(); i++) {
+            const ClusterNode& n = tree[i];
+            out << i << " " << n.left << " " << n.right << " " << n.label << " "
+                << n.size() << " " << n.sse << " " << n.centroid.x << " " << n.centroid.y << "\n";
+        }
+        if (!out) throw std::runtime_error("cannot write " + path);
+    }
+};
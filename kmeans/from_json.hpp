@@ -7,12 +7,14 @@
 
 using namespace Grappa;
 
-void read_points(GPoint _points, size_t num_points) {
-    int i=0;
+/**
+ * Reads the first num_points [x, y] pairs of the JSON array in `path` into
+ * `_points`; throws if the file holds fewer.
+ */
+void read_points(GPoint _points, size_t num_points, const std::string& path = "../points.json") {
     json_t *json;
     json_error_t error;
     size_t index;
-    long int temp = 0;
     json_t *value;
 
     std::cout << "reading points... " ;
@@ -20,15 +22,21 @@ void read_points(GPoint _points, size_t num_points) {
     double* xs = new double[num_points];
     double* ys = new double[num_points];
 
-    json = json_load_file("../points.json", 0, &error);
+    json = json_load_file(path.c_str(), 0, &error);
     if(!json) {
-        throw std::runtime_error("Error parsing Json file");
+        throw std::runtime_error("Error parsing Json file " + path);
+    }
+    if (json_array_size(json) < num_points) {
+        throw std::runtime_error(path + " holds " + std::to_string(json_array_size(json)) +
+                                 " points, fewer than " + std::to_string(num_points));
     }
 
     json_array_foreach(json, index, value) {
+        if (index >= num_points) break;
         xs[index] = json_number_value(json_array_get(value,0));
         ys[index] = json_number_value(json_array_get(value,1));
     }
+    json_decref(json);
 
     std::cout << "done " << std::endl;
 
@@ -36,11 +44,14 @@ void read_points(GPoint _points, size_t num_points) {
     std::cout << "writing to GlobalMem... " ;
 
 
-    for(int i = 0; i < num_points; i++){
+    for(size_t i = 0; i < num_points; i++){
         Point p(xs[i],ys[i]);
         delegate::write(_points+i,p);
     }
 
+    delete [] xs;
+    delete [] ys;
+
     std::cout << "done" << std::endl;
 
 }
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <Grappa.hpp>
+#include <cmath>
+#include <cstdint>
+
+#include "Point.hpp"
+
+
+using namespace Grappa;
+
+// splitmix64: a well-mixed 64-bit value for every input, so any core can derive any point.
+inline uint64_t mix64(uint64_t x) {
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+// A uniform double in (0, 1) from the top 53 bits.
+inline double unit(uint64_t x) { return ((x >> 11) + 0.5) / 9007199254740992.0; }
+
+/**
+ * Fills `points` with synthetic data: point i is drawn from a unit-variance
+ * gaussian around centre i % num_blobs, and the centres are spread
+ * uniformly over [0, 100)^2. Every point is a function of (seed, i) alone,
+ * so each core writes its own part of the array with no communication and
+ * the data does not depend on the core count.
+ */
+void generate_points(GPoint points, int64_t num_points, int num_blobs, uint64_t seed) {
+    std::cout << "generating " << num_points << " points around " << num_blobs << " centres... ";
+    forall(points, num_points, [=](int64_t i, Point& p) {
+        uint64_t blob = i % num_blobs;
+        double cx = 100 * unit(mix64(seed ^ (2 * blob)));
+        double cy = 100 * unit(mix64(seed ^ (2 * blob + 1)));
+        // Box-Muller: two independent normals from two uniforms
+        double r = std::sqrt(-2 * std::log(unit(mix64(seed + 2 * i + 0x1000))));
+        double theta = 2 * M_PI * unit(mix64(seed + 2 * i + 0x1001));
+        p = Point(cx + r * std::cos(theta), cy + r * std::sin(theta));
+    });
+    std::cout << "done" << std::endl;
+}
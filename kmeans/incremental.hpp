@@ -0,0 +1,136 @@
+#pragma once
+
+#include <Grappa.hpp>
+#include <algorithm>
+
+#include "Point.hpp"
+#include "lloyd.hpp"
+
+
+using namespace Grappa;
+
+/**
+ * Growable distributed point store: points and their labels live in two
+ * global arrays that double in capacity when full, so an append is amortized
+ * O(1) per point and the store always stays one contiguous range the
+ * Lloyd kernels can run over.
+ */
+template <typename Label>
+struct PointStore {
+    GPoint         points;
+    GLabels<Label> clusters;
+    int64_t size = 0;
+    int64_t capacity = 0;
+
+    PointStore(int64_t capacity_) :
+        points(global_alloc<Point>(capacity_)),
+        clusters(global_alloc<Label>(capacity_)),
+        capacity(capacity_) {}
+
+    void reserve(int64_t wanted) {
+        if (wanted <= capacity) return;
+        int64_t new_capacity = std::max(wanted, 2 * capacity);
+
+        GPoint         fresh_points   = global_alloc<Point>(new_capacity);
+        GLabels<Label> fresh_clusters = global_alloc<Label>(new_capacity);
+
+        // each element is copied by the core that owns its new home
+        GPoint         old_points   = points;
+        GLabels<Label> old_clusters = clusters;
+        forall(fresh_points, size, [old_points](int64_t i, Point& p) {
+            p = delegate::read(old_points + i);
+        });
+        forall(fresh_clusters, size, [old_clusters](int64_t i, Label& k) {
+            k = delegate::read(old_clusters + i);
+        });
+
+        global_free(points);
+        global_free(clusters);
+        points   = fresh_points;
+        clusters = fresh_clusters;
+        capacity = new_capacity;
+    }
+
+    // Appends `n` points held by the calling core; returns the index of the first.
+    int64_t append(const Point* batch, int64_t n) {
+        reserve(size + n);
+        int64_t first = size;
+        GPoint dest = points + first;
+        forall_here(0, n, [=](int64_t i) {
+            delegate::write(dest + i, batch[i]);
+        });
+        size += n;
+        return first;
+    }
+};
+
+/**
+ * Online kmeans over a PointStore. Appended points are labelled against the
+ * current centroids and folded into the running per-cluster sums/counts;
+ * older points are never rescanned. Once any centroid has moved more than
+ * `drift_threshold` since the last full clustering, all points are
+ * re-clustered with Lloyd's algorithm.
+ */
+template <typename Label>
+struct IncrementalKMeans {
+    PointStore<Label> store;
+    int     num_clusters;
+    int     niters;
+    double  drift_threshold;
+
+    GPoint  centroids;
+    GPoint  anchors;        // centroids as of the last full clustering
+    GPoint  sums;
+    GCount  counts;
+    int     reclusters = 0;
+
+    IncrementalKMeans(int num_clusters_, int niters_, double drift_threshold_, int64_t capacity) :
+        store(std::max<int64_t>(capacity, num_clusters_)),
+        num_clusters(num_clusters_),
+        niters(niters_),
+        drift_threshold(drift_threshold_),
+        centroids(global_alloc<Point>(num_clusters_)),
+        anchors(global_alloc<Point>(num_clusters_)),
+        sums(global_alloc<Point>(num_clusters_)),
+        counts(global_alloc<int64_t>(num_clusters_)) {}
+
+    void recluster() {
+        lloyd(store.points, store.clusters, centroids, num_clusters, store.size, sums, counts, niters);
+        for (int k = 0; k < num_clusters; k++)
+            delegate::write(anchors + k, delegate::read(centroids + k));
+        reclusters++;
+    }
+
+    double drift() {
+        double max_d = 0;
+        for (int k = 0; k < num_clusters; k++)
+            max_d = std::max(max_d, dist(delegate::read(centroids + k), delegate::read(anchors + k)));
+        return max_d;
+    }
+
+    /**
+     * Adds a batch held by the calling core. The very first batch seeds the
+     * centroids and must hold at least `num_clusters` points.
+     * Returns true if the batch triggered a full re-clustering.
+     */
+    bool add(const Point* batch, int64_t n) {
+        int64_t first = store.append(batch, n);
+
+        if (first == 0) {
+            reset_centroids(store.points, centroids, store.size, num_clusters);
+            recluster();
+            return true;
+        }
+
+        assign_clusters(store.points, store.clusters, centroids, num_clusters, first, n, sums, counts);
+        update_centroids(centroids, sums, counts, num_clusters);
+
+        double d = drift();
+        DVLOG(2) << "appended " << n << " points, drift " << d;
+        if (d > drift_threshold) {
+            recluster();
+            return true;
+        }
+        return false;
+    }
+};
@@ -0,0 +1,153 @@
+#pragma once
+
+#include <Grappa.hpp>
+#include "Point.hpp"
+#include "slice.hpp"
+
+
+typedef GlobalAddress<int64_t> GCount;
+
+// Cluster labels are stored at the narrowest unsigned width that fits k
+// (see main_body); every kernel that touches them is templated on it.
+template <typename Label>
+using GLabels = GlobalAddress<Label>;
+using namespace Grappa;
+
+void reset_centroids(GPoint _points, GPoint _centroids, size_t num_points, size_t num_centroids) {
+    for(int i = 0; i < num_centroids; i++){
+        Point p = delegate::read(_points+i);
+        delegate::write(_centroids+i, p);
+    }
+}
+
+template <typename Label>
+void reset_clusters(GLabels<Label> _clusters, size_t num_points) {
+    for(int64_t i = 0; i < num_points; i++){
+        delegate::write(_clusters+i, 0);
+    }
+}
+
+void reset_sums(GPoint _sums, GCount _counts, int num_clusters) {
+    for(int i = 0; i < num_clusters; i++){
+        delegate::write(_sums+i, Point());
+        delegate::write(_counts+i, 0);
+    }
+}
+
+
+
+int closest(Point point, Point* centroids, int num_centroids)
+{
+    int _closest=0;
+    double min_d=dist(point,centroids[0]);
+
+    for(int i=1;i<num_centroids;i++)
+    {
+        double d = dist(point,centroids[i]);
+        if(min_d >= d)
+        {
+            _closest=i;
+            min_d=d;
+        }
+    }
+    return _closest;
+}
+
+/**
+ * Labels points [first, first + num_points) against the current centroids.
+ * Each core fetches the centroids and its own slice of the points, writes
+ * the labels back and folds its points into per-cluster partial sums, which
+ * are then added to `gsums`/`gcounts` with one delegate per cluster.
+ */
+template <typename Label>
+void assign_clusters(GPoint gpoints, GLabels<Label> gclusters, GPoint gcentroids, int num_clusters,
+                     int64_t first, int64_t num_points, GPoint gsums, GCount gcounts)
+{
+    on_all_cores([=]{
+
+        Slice mine = core_slice(num_points);
+        int64_t my_offset = first + mine.offset;
+        int64_t my_job_size = mine.size;
+
+        Point*   points    = new Point[my_job_size];
+        Label*   labels    = new Label[my_job_size];
+        Point*   centroids = new Point[num_clusters];
+        Point*   sums      = new Point[num_clusters];
+        int64_t* counts    = new int64_t[num_clusters]();
+
+        DVLOG(3) << "fetch centroids " << my_job_size;
+
+        forall_here(0, num_clusters, [=](int64_t i) {
+            centroids[i] = delegate::read(gcentroids+i);
+        });
+
+        DVLOG(3) << "fetch points " << my_job_size;
+
+        forall_here(0, my_job_size, [=](int64_t i) {
+            points[i] = delegate::read(gpoints + my_offset + i);
+        });
+
+        DVLOG(3) << "points were fetched. start";
+
+        for (int64_t j = 0; j < my_job_size; j++) {
+            int k = closest(points[j], centroids, num_clusters);
+            labels[j] = k;
+            sums[k] += points[j];
+            counts[k]++;
+        }
+
+        // write back gclusters to gmemory
+        forall_here(0, my_job_size, [=](int64_t j) {
+            delegate::write(gclusters + my_offset + j, labels[j]);
+        });
+
+        forall_here(0, num_clusters, [=](int64_t k) {
+            if (counts[k] == 0) return;
+            delegate::increment(gsums + k, sums[k]);
+            delegate::increment(gcounts + k, counts[k]);
+        });
+        DVLOG(3) << "finished work.";
+
+        delete [] points;
+        delete [] labels;
+        delete [] centroids;
+        delete [] sums;
+        delete [] counts;
+    });
+}
+
+/**
+ * centroid = sum / count for every cluster; an empty cluster keeps its
+ * previous centroid.
+ */
+void update_centroids(GPoint centroids, GPoint sums, GCount counts, int num_clusters)
+{
+    DVLOG(3) << "update_centroids";
+
+    for(int64_t i = 0; i < num_clusters; i++) {
+        int64_t population = delegate::read(counts + i);
+        if(population != 0)
+            delegate::write(centroids+i, delegate::read(sums + i) / population);
+    };
+
+    DVLOG(3) << "centroids updated";
+}
+
+/**
+ * `niters` rounds of Lloyd's algorithm over points [0, num_points), starting
+ * from the current centroids. On return `sums`/`counts` describe the final
+ * assignment, so callers can keep updating them incrementally.
+ */
+template <typename Label>
+void lloyd(GPoint gpoints, GLabels<Label> gclusters, GPoint gcentroids, int num_clusters,
+           int64_t num_points, GPoint gsums, GCount gcounts, int niters)
+{
+    for(int iter = 0; iter < niters; iter++)
+    {
+        DVLOG(3) << "iter " << iter;
+
+        reset_sums(gsums, gcounts, num_clusters);
+        assign_clusters(gpoints, gclusters, gcentroids, num_clusters, 0, num_points, gsums, gcounts);
+        update_centroids(gcentroids, gsums, gcounts, num_clusters);
+    }
+}
@@ -1,6 +1,10 @@
-GRAPPA_HOME=$HOME/Devel/Cpp/grappa_master
-GRAPPA_BUILD_DIR=$GRAPPA_HOME/build/Make+Release
+BACKEND=${BACKEND:-grappa}
+GRAPPA_HOME=${GRAPPA_HOME:-$HOME/Devel/Cpp/grappa_master}
+GRAPPA_BUILD_DIR=${GRAPPA_BUILD_DIR:-$GRAPPA_HOME/build/Make+Release}
 
+if [ "$BACKEND" = shm ]; then
+g++ -w -std=c++11 -fpermissive -O3 -fno-strict-aliasing -pthread -I../shm -o KMeans KMeans.cpp -ljansson
+else
 g++ -c  -w -std=c++11 -w -fpermissive -O3 -fno-strict-aliasing -I$GRAPPA_HOME/system -I$GRAPPA_HOME/system/tasks -I$GRAPPA_BUILD_DIR/third-party/include -I/usr/include/mpich -o KMeans.o KMeans.cpp
 g++   -o KMeans KMeans.o  -lGrappa -lglog -lgflags -ldl -lutil -lmpi -lz -lm -lc -lpthread -lboost_system -lboost_filesystem -L/usr/local/lib -L$GRAPPA_BUILD_DIR/system -L$GRAPPA_BUILD_DIR/third-party/lib -ljansson -ldl
-                                                            
+fi
@@ -0,0 +1,18 @@
+#pragma once
+#include <Grappa.hpp>
+
+
+// The contiguous block of [0, n) a core works on: n / cores() elements
+// each, with the remainder going to the last core.
+struct Slice {
+    int64_t offset;
+    int64_t size;
+};
+
+Slice core_slice(int64_t n, Grappa::Core core = Grappa::mycore()) {
+    int64_t job_size = n / Grappa::cores();
+    Slice s { job_size * core, job_size };
+    if (core == Grappa::cores() - 1)
+        s.size += n % Grappa::cores();
+    return s;
+}
@@ -0,0 +1,107 @@
+#pragma once
+
+#include <Grappa.hpp>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cerrno>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <stdexcept>
+
+#include "Point.hpp"
+#include "slice.hpp"
+
+
+using namespace Grappa;
+
+// Binary label file layout: a fixed header followed by one label per point,
+// in point order, each `width` bytes wide (host byte order).
+struct LabelsHeader {
+    char     magic[4] = { 'K', 'M', 'L', 'B' };
+    uint32_t width    = 0;
+    uint64_t count    = 0;
+};
+
+void pwrite_fully(int fd, const void* buf, size_t nbytes, off_t offset) {
+    const char* p = (const char*) buf;
+    while (nbytes > 0) {
+        ssize_t n = pwrite(fd, p, nbytes, offset);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            throw std::runtime_error(std::string("pwrite failed: ") + strerror(errno));
+        }
+        p += n; offset += n; nbytes -= n;
+    }
+}
+
+/**
+ * Collective export of the cluster assignments.
+ * The master sizes the file and writes the header; then every core fetches its
+ * own slice of `clusters` and writes it at its offset with a single pwrite,
+ * so nothing is funnelled through core 0.
+ */
+template <typename Label>
+void write_labels(const std::string& path, GlobalAddress<Label> clusters, size_t num_points) {
+    // lambdas are shipped to the other cores by value: capture a plain array
+    char fname[256];
+    if (path.size() >= sizeof(fname))
+        throw std::runtime_error("output path too long: " + path);
+    strcpy(fname, path.c_str());
+
+    LabelsHeader header;
+    header.width = sizeof(Label);
+    header.count = num_points;
+
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+        throw std::runtime_error("cannot create " + path + ": " + strerror(errno));
+    if (ftruncate(fd, sizeof(header) + num_points * sizeof(Label)) != 0)
+        throw std::runtime_error("cannot size " + path + ": " + strerror(errno));
+    pwrite_fully(fd, &header, sizeof(header), 0);
+    close(fd);
+
+    on_all_cores([=]{
+        Slice mine = core_slice(num_points);
+        if (mine.size == 0) return;
+
+        Label* labels = new Label[mine.size];
+        forall_here(0, mine.size, [=](int64_t i) {
+            labels[i] = delegate::read(clusters + mine.offset + i);
+        });
+
+        int fd = open(fname, O_WRONLY);
+        if (fd < 0)
+            throw std::runtime_error(std::string("cannot open ") + fname + ": " + strerror(errno));
+        pwrite_fully(fd, labels, mine.size * sizeof(Label),
+                     sizeof(LabelsHeader) + mine.offset * sizeof(Label));
+        close(fd);
+
+        delete [] labels;
+    });
+}
+
+/**
+ * Writes the k centroids once, from the master: `path`.bin holds the raw
+ * (x, y) doubles, `path`.txt one "x y" pair per line.
+ */
+void write_centroids(const std::string& path, GPoint centroids, size_t num_centroids) {
+    Point* local = new Point[num_centroids];
+    for (size_t i = 0; i < num_centroids; i++)
+        local[i] = delegate::read(centroids + i);
+
+    std::ofstream bin(path + ".bin", std::ios::binary);
+    for (size_t i = 0; i < num_centroids; i++) {
+        bin.write((const char*) &local[i].x, sizeof(double));
+        bin.write((const char*) &local[i].y, sizeof(double));
+    }
+    if (!bin) throw std::runtime_error("cannot write " + path + ".bin");
+
+    std::ofstream txt(path + ".txt");
+    txt << std::setprecision(17);
+    for (size_t i = 0; i < num_centroids; i++)
+        txt << local[i].x << " " << local[i].y << "\n";
+    if (!txt) throw std::runtime_error("cannot write " + path + ".txt");
+
+    delete [] local;
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <utility>
+#include <vector>
+
+
+/**
+ * Persistent threads for banded stepping. Band b always runs on the same
+ * thread (band 0 on the caller), so its lines stay in that thread's cache
+ * and, if that thread touched them first, in its NUMA node. run() costs one
+ * wake-up and one join per call; no threads are created after construction.
+ */
+class BandPool {
+    int nbands;
+    std::vector<std::thread> workers;
+    std::mutex lock;
+    std::condition_variable wake, done;
+    std::function<void(int)> job;
+    long generation = 0;
+    int pending = 0;
+    bool stopping = false;
+
+    void work(int band) {
+        long seen = 0;
+        for (;;) {
+            {
+                std::unique_lock<std::mutex> g(lock);
+                wake.wait(g, [&]{ return stopping || generation != seen; });
+                if (stopping) return;
+                seen = generation;
+            }
+            job(band);
+            std::lock_guard<std::mutex> g(lock);
+            if (--pending == 0) done.notify_one();
+        }
+    }
+
+public:
+    BandPool(int nbands_) : nbands(nbands_ < 1 ? 1 : nbands_) {
+        for (int b = 1; b < nbands; b++)
+            workers.emplace_back(&BandPool::work, this, b);
+    }
+
+    ~BandPool() {
+        {
+            std::lock_guard<std::mutex> g(lock);
+            stopping = true;
+        }
+        wake.notify_all();
+        for (auto& t : workers) t.join();
+    }
+
+    BandPool(const BandPool&) = delete;
+    BandPool& operator=(const BandPool&) = delete;
+
+    int size() const { return nbands; }
+
+    // The [first, second) share of [begin, end) that band b works on.
+    std::pair<long,long> band(long begin, long end, int b) const {
+        long n = end - begin;
+        return std::make_pair(begin + n * b / nbands, begin + n * (b + 1) / nbands);
+    }
+
+    // Runs f(b) for every band b and returns when all of them are done.
+    void run(const std::function<void(int)>& f) {
+        if (nbands == 1) { f(0); return; }
+        {
+            std::lock_guard<std::mutex> g(lock);
+            job = f;
+            pending = nbands - 1;
+            generation++;
+        }
+        wake.notify_all();
+        job(0);
+        std::unique_lock<std::mutex> g(lock);
+        done.wait(g, [&]{ return pending == 0; });
+    }
+};
@@ -0,0 +1,144 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <memory>
+#include <utility>
+
+#include "BandPool.hpp"
+#include "Rule.hpp"
+
+
+/**
+ * Bit-packed Game of Life board: every row of `width` cells is packed 64
+ * cells per word, so a step advances 64 cells per word operation and the
+ * board needs 1 bit per cell. Coordinates follow Game: the board is
+ * [1, height] x [1, width] and everything outside it is dead.
+ */
+class BitGame {
+    size_t height, width;
+    size_t words_per_row;
+    uint64_t last_mask;                  // valid bits of the last word of a row
+    std::unique_ptr<uint64_t[]> cells;   // (height + 2) rows, the first and last always empty
+    std::unique_ptr<uint64_t[]> next;
+    BandPool bands;                      // band b always steps the same rows
+    Rule rule;
+    bool conway;                         // B3/S23 keeps its short closed form
+
+    uint64_t* row(size_t i) { return &cells[i * words_per_row]; }
+
+    std::pair<long,long> rows_of(int b) { return bands.band(1, height + 1, b); }
+
+    // 3-bit full adder over 64 lanes
+    static void add3(uint64_t a, uint64_t b, uint64_t c, uint64_t& sum, uint64_t& carry) {
+        uint64_t t = a ^ b;
+        sum = t ^ c;
+        carry = (a & b) | (t & c);
+    }
+
+public:
+    BitGame(size_t height_, size_t width_, int threads = 1, const Rule& rule_ = Rule()) :
+        height(height_),
+        width(width_),
+        words_per_row((width_ + 63) / 64),
+        last_mask(width_ % 64 ? (~0ULL >> (64 - width_ % 64)) : ~0ULL),
+        cells(new uint64_t[(height_ + 2) * words_per_row]),
+        next(new uint64_t[(height_ + 2) * words_per_row]),
+        bands(threads),
+        rule(rule_),
+        conway(rule_ == Conway::rule())
+    {
+        // first touch by the owning thread; the first and last band also take the guard rows
+        bands.run([this](int b) {
+            std::pair<long,long> rows = rows_of(b);
+            if (b == 0) rows.first = 0;
+            if (b == bands.size() - 1) rows.second = height + 2;
+            std::fill(&cells[rows.first * words_per_row], &cells[rows.second * words_per_row], 0);
+            std::fill(&next[rows.first * words_per_row], &next[rows.second * words_per_row], 0);
+        });
+    }
+
+    bool alive(long i, long j) const {
+        if (i < 1 || i > (long)height || j < 1 || j > (long)width) return false;
+        size_t c = j - 1;
+        return (cells[i * words_per_row + c / 64] >> (c % 64)) & 1;
+    }
+
+    void set(long i, long j, bool is_alive) {
+        size_t c = j - 1;
+        uint64_t bit = 1ULL << (c % 64);
+        uint64_t& w = row(i)[c / 64];
+        w = is_alive ? (w | bit) : (w & ~bit);
+    }
+
+    // Brings cells (i, j) .. (i, j + n - 1) to life a word at a time.
+    void set_run(long i, long j, long n) {
+        uint64_t* r = row(i);
+        for (size_t c = j - 1, c_end = j - 1 + n; c < c_end; ) {
+            size_t bits = std::min<size_t>(64 - c % 64, c_end - c);
+            uint64_t mask = (bits == 64 ? ~0ULL : ((1ULL << bits) - 1)) << (c % 64);
+            r[c / 64] |= mask;
+            c += bits;
+        }
+    }
+
+    void step_rows(size_t i_begin, size_t i_end) {
+        const size_t W = words_per_row;
+        for (size_t i = i_begin; i < i_end; i++) {
+            const uint64_t* up   = &cells[(i - 1) * W];
+            const uint64_t* mid  = &cells[i * W];
+            const uint64_t* down = &cells[(i + 1) * W];
+            uint64_t* out = &next[i * W];
+
+            for (size_t w = 0; w < W; w++) {
+                // neighbours to the west/east land on a cell's bit by shifting,
+                // pulling the edge bit in from the adjacent word
+                uint64_t uw = (up[w]   << 1) | (w > 0     ? up[w-1]   >> 63 : 0);
+                uint64_t ue = (up[w]   >> 1) | (w + 1 < W ? up[w+1]   << 63 : 0);
+                uint64_t mw = (mid[w]  << 1) | (w > 0     ? mid[w-1]  >> 63 : 0);
+                uint64_t me = (mid[w]  >> 1) | (w + 1 < W ? mid[w+1]  << 63 : 0);
+                uint64_t dw = (down[w] << 1) | (w > 0     ? down[w-1] >> 63 : 0);
+                uint64_t de = (down[w] >> 1) | (w + 1 < W ? down[w+1] << 63 : 0);
+
+                // count the 8 neighbours as ones + 2*twos + 4*(fours_a + fours_b)
+                uint64_t s_up, c_up, s_down, c_down, ones, c_ones, twos_t, fours_a;
+                add3(uw, up[w], ue, s_up, c_up);
+                add3(dw, down[w], de, s_down, c_down);
+                uint64_t s_mid = mw ^ me, c_mid = mw & me;
+                add3(s_up, s_mid, s_down, ones, c_ones);
+                add3(c_up, c_mid, c_down, twos_t, fours_a);
+                uint64_t twos = twos_t ^ c_ones;
+                uint64_t fours_b = twos_t & c_ones;
+
+                if (conway) {
+                    // alive next iff count == 3, or count == 2 and alive now
+                    out[w] = twos & ~(fours_a | fours_b) & (ones | mid[w]);
+                    continue;
+                }
+
+                // count bit-planes c0..c3; a lane is born or survives if its
+                // count is one of the rule's, tested as one minterm per count
+                uint64_t planes[4] = { ones, twos, fours_a ^ fours_b, fours_a & fours_b };
+                uint64_t born = 0, kept = 0;
+                for (int n = 0; n <= 8; n++) {
+                    bool b = (rule.birth >> n) & 1, s = (rule.survive >> n) & 1;
+                    if (!b && !s) continue;
+                    uint64_t is_n = ~0ULL;
+                    for (int p = 0; p < 4; p++) is_n &= ((n >> p) & 1) ? planes[p] : ~planes[p];
+                    if (b) born |= is_n;
+                    if (s) kept |= is_n;
+                }
+                out[w] = (born & ~mid[w]) | (kept & mid[w]);
+            }
+            out[W - 1] &= last_mask;
+        }
+    }
+
+    void step() {
+        bands.run([this](int b) {
+            std::pair<long,long> rows = rows_of(b);
+            step_rows(rows.first, rows.second);
+        });
+        cells.swap(next);
+    }
+};
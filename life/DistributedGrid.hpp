@@ -0,0 +1,432 @@
+#pragma once
+
+#include <Grappa.hpp>
+#include <algorithm>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+
+/**
+ * How an H x W grid, indexed [1, H] x [1, W], is cut into blocks of
+ * block_rows x block_cols cells, numbered row-major. The last row and
+ * column of blocks take what is left, which is less, or more where a
+ * remainder thinner than min_side was merged into them. Plain data, so a
+ * copy travels with every lambda that needs it.
+ */
+struct BlockLayout {
+    long height = 0, width = 0;
+    long block_rows = 1, block_cols = 1;
+    long nbr = 0, nbc = 0;          // blocks down and across
+
+    BlockLayout() {}
+
+    // side > 0: square blocks; otherwise one block per core on the squarest process grid
+    BlockLayout(long height_, long width_, long side, long ncores, long min_side = 1) :
+        height(height_), width(width_)
+    {
+        if (side > 0) {
+            block_rows = block_cols = side;
+        } else {
+            long pr = 1;
+            for (long d = 1; d * d <= ncores; d++) if (ncores % d == 0) pr = d;
+            long pc = ncores / pr;
+            if (height > width) std::swap(pr, pc);
+            block_rows = std::max(1L, (height + pr - 1) / pr);
+            block_cols = std::max(1L, (width + pc - 1) / pc);
+        }
+        nbr = count(height, block_rows, min_side);
+        nbc = count(width, block_cols, min_side);
+    }
+
+    // Blocks of `side` cells along `extent`, a last one thinner than min_side merged into the one before.
+    static long count(long extent, long side, long min_side) {
+        long n = (extent + side - 1) / side;
+        if (n > 1 && extent - (n - 1) * side < min_side) n--;
+        return n;
+    }
+
+    long blocks() const { return nbr * nbc; }
+    long block_of(long i, long j) const {
+        return std::min((i - 1) / block_rows, nbr - 1) * nbc + std::min((j - 1) / block_cols, nbc - 1);
+    }
+    long rows_of(long b) const { return b / nbc == nbr - 1 ? height - (nbr - 1) * block_rows : block_rows; }
+    long cols_of(long b) const { return b % nbc == nbc - 1 ? width - (nbc - 1) * block_cols : block_cols; }
+    long first_row(long b) const { return 1 + b / nbc * block_rows; }
+    long first_col(long b) const { return 1 + b % nbc * block_cols; }
+    bool contains(long i, long j) const { return i >= 1 && i <= height && j >= 1 && j <= width; }
+
+    // neighbour of block b at (dr, dc), or -1 past the grid edge
+    long neighbour(long b, int dr, int dc) const {
+        long r = b / nbc + dr, c = b % nbc + dc;
+        return (r < 0 || r >= nbr || c < 0 || c >= nbc) ? -1 : r * nbc + c;
+    }
+
+    // Initial ownership: consecutive block ids on the same core.
+    Grappa::Core default_owner(long b, long ncores) const { return (Grappa::Core)(b * ncores / blocks()); }
+};
+
+// No per-block information beyond the cells.
+struct NoBlockInfo {};
+
+/**
+ * A grid of T distributed by 2D blocks. Every core holds the blocks it owns,
+ * each padded with a halo Halo cells deep, and a copy of the ownership map
+ * (block id -> core). Iteration is owner-computes: forall_blocks() and
+ * forall_cells() run every block on its owner, where every cell within
+ * Halo of a cell is a plain memory read at (i +- Halo, j +- Halo). Only
+ * block edges travel, in bulk, when halos are exchanged; halos past the
+ * grid edge keep their initial value. Blocks must be at least Halo cells
+ * on a side wherever they have a neighbour, so a halo comes from the
+ * adjacent blocks alone; a last row or column of blocks thinner than that
+ * is merged into the one before.
+ *
+ * Ownership is not fixed: migrate() moves whole blocks, cells and Info,
+ * to new owners in one message each, and balanced_owners() plans an
+ * assignment from per-block weights gathered with gather_weights().
+ *
+ * The grid object itself is a small handle: copy it into lambdas freely.
+ * T and Info travel as raw bytes and must be trivially copyable.
+ */
+template <typename T, typename Info = NoBlockInfo, int Halo = 1>
+class DistributedGrid {
+public:
+    typedef T Cell;
+    static const int halo = Halo;
+
+    // A block's cells with their halo: (rows + 2 Halo) x (cols + 2 Halo), row-major.
+    // row(r)[c] is cell (i0 + r - 1, j0 + c - 1), for r and c from 1 - Halo to rows/cols + Halo.
+    struct Block {
+        long id, rows, cols, i0, j0;
+        long activity = 1;              // set by the code stepping the block; 0 means it did not change
+        long neighbour_activity = 0;    // sum of the neighbours' activity in the last exchange
+        long incoming_activity = 0;     // the same, summed as the current exchange's halos arrive
+        Info info;                      // whatever the user keeps per block; moves with it
+        std::vector<T> cells;
+        std::vector<T> edges[9];        // post_halos(): the edge sent towards (dr, dc), kept until it arrives
+
+        long stride() const { return cols + 2 * Halo; }
+        T* row(long r) { return &cells[(r + Halo - 1) * stride() + Halo - 1]; }
+        T& at(long i, long j) { return row(i - i0 + 1)[j - j0 + 1]; }
+        bool contains(long i, long j) const { return i >= i0 && i < i0 + rows && j >= j0 && j < j0 + cols; }
+    };
+
+    // What one core holds of a grid.
+    struct Local {
+        std::vector<Block> blocks;
+        std::vector<long> index_of;             // block id -> position in `blocks`, -1 if not ours
+        std::vector<Grappa::Core> owners;       // block id -> core, the same on every core
+        long expected_halos = 0;                // halo messages per exchange
+        Grappa::CompletionEvent halos;
+        Grappa::CompletionEvent transfers;      // weights and blocks arriving from other cores
+        std::vector<double> weights;            // gather_weights(): block id -> weight
+        std::vector<Block> arrivals;            // migrate(): blocks received, not yet merged
+
+        Block& block(long id) { return blocks[index_of[id]]; }
+    };
+
+    BlockLayout layout;
+    GlobalAddress<Local> local;
+
+    DistributedGrid() {}
+
+    // Collective: every core builds its blocks, filled with `fill`, halos included.
+    DistributedGrid(long height, long width, long block_side = 0, T fill = T()) :
+        layout(height, width, block_side, Grappa::cores(), Halo),
+        local(Grappa::symmetric_global_alloc<Local>())
+    {
+        for (long b = 0; b < layout.blocks(); b++)
+            if ((layout.nbr > 1 && layout.rows_of(b) < Halo) || (layout.nbc > 1 && layout.cols_of(b) < Halo))
+                throw std::runtime_error("blocks of " + std::to_string(layout.rows_of(b)) + "x" +
+                                         std::to_string(layout.cols_of(b)) + " cells are thinner than the " +
+                                         std::to_string(Halo) + "-cell halo");
+
+        const BlockLayout l = layout;
+        GlobalAddress<Local> mine = local;
+        Grappa::on_all_cores([l, mine, fill]{
+            Local* me = new (mine.localize()) Local();
+            me->index_of.assign(l.blocks(), -1);
+            me->owners.resize(l.blocks());
+            for (long b = 0; b < l.blocks(); b++) {
+                me->owners[b] = l.default_owner(b, Grappa::cores());
+                if (me->owners[b] != Grappa::mycore()) continue;
+                Block blk;
+                blk.id = b;
+                blk.rows = l.rows_of(b);
+                blk.cols = l.cols_of(b);
+                blk.i0 = l.first_row(b);
+                blk.j0 = l.first_col(b);
+                blk.cells.assign((blk.rows + 2 * Halo) * (blk.cols + 2 * Halo), fill);
+                me->index_of[b] = me->blocks.size();
+                me->blocks.push_back(std::move(blk));
+            }
+            count_halos(l, *me);
+            me->halos.enroll(me->expected_halos);     // armed for the first exchange
+        });
+    }
+
+    // Collective: frees every core's blocks. The handle must not be used afterwards.
+    void destroy() {
+        GlobalAddress<Local> mine = local;
+        Grappa::on_all_cores([mine]{ mine.localize()->~Local(); });
+        Grappa::global_free(local);
+    }
+
+    long height() const { return layout.height; }
+    long width() const { return layout.width; }
+    bool contains(long i, long j) const { return layout.contains(i, j); }
+    long block_of(long i, long j) const { return layout.block_of(i, j); }
+
+    // The calling core's blocks.
+    Local& mine() const { return *local.localize(); }
+
+    Grappa::Core owner_of_block(long b) const { return mine().owners[b]; }
+    Grappa::Core owner(long i, long j) const { return owner_of_block(block_of(i, j)); }
+
+    // A cell of a block the calling core owns.
+    T& local_cell(long i, long j) const { return mine().block(block_of(i, j)).at(i, j); }
+
+    /**
+     * From any core: writes one cell on its owner and marks its block
+     * active. Cells off the grid are ignored.
+     */
+    void set(long i, long j, T value) const {
+        if (!contains(i, j)) return;
+        const DistributedGrid g = *this;
+        Grappa::delegate::call(owner(i, j), [g, i, j, value]{
+            Block& blk = g.mine().block(g.block_of(i, j));
+            blk.at(i, j) = value;
+            blk.activity = std::max(blk.activity, 1L);
+        });
+    }
+
+    T get(long i, long j) const {
+        if (!contains(i, j)) return T();
+        const DistributedGrid g = *this;
+        return Grappa::delegate::call(owner(i, j), [g, i, j]{ return g.local_cell(i, j); });
+    }
+
+    /**
+     * Sends every edge of the calling core's blocks to the neighbouring
+     * block's halo, one message per edge or corner. Inside on_all_cores.
+     * Every core keeps `halos` enrolled for its next exchange (from
+     * construction, wait_halos() and migrate()), so a halo may arrive at any
+     * time and no collective precedes the posting. What an exchange needs
+     * is that it does not overlap the previous one: a halo must not arrive
+     * before its receiver's last wait_halos() returned, which the task
+     * joining between generations (one on_all_cores per step) guarantees.
+     * The same join means every edge sent last exchange has arrived, so
+     * each block's edge buffers, which the messages point into until they
+     * go out, are free to refill.
+     */
+    void post_halos() const {
+        Local& me = mine();
+        GlobalAddress<Local> dest = local;
+        for (Block& b : me.blocks) {
+            for (int dr = -1; dr <= 1; dr++) {
+                for (int dc = -1; dc <= 1; dc++) {
+                    long nb = layout.neighbour(b.id, dr, dc);
+                    if ((!dr && !dc) || nb < 0) continue;
+
+                    // my cells next to the neighbour: first/last Halo rows/columns, or all of them
+                    long r0 = dr > 0 ? b.rows - Halo + 1 : 1, r1 = dr < 0 ? Halo : b.rows;
+                    long c0 = dc > 0 ? b.cols - Halo + 1 : 1, c1 = dc < 0 ? Halo : b.cols;
+                    std::vector<T>& edge = b.edges[(dr + 1) * 3 + dc + 1];
+                    edge.clear();
+                    for (long r = r0; r <= r1; r++)
+                        edge.insert(edge.end(), b.row(r) + c0, b.row(r) + c1 + 1);
+
+                    long activity = b.activity;
+                    Grappa::send_heap_message(me.owners[nb], [dest, nb, dr, dc, activity](void* payload, size_t size) {
+                        Local& them = *dest.localize();
+                        Block& n = them.block(nb);
+                        n.incoming_activity += activity;
+                        // the halo on the side facing the sender
+                        long r0 = dr < 0 ? n.rows + 1 : dr > 0 ? 1 - Halo : 1;
+                        long c0 = dc < 0 ? n.cols + 1 : dc > 0 ? 1 - Halo : 1;
+                        long width = dc ? Halo : n.cols;
+                        const T* src = (const T*) payload;
+                        long count = size / sizeof(T);
+                        for (long k = 0; k < count; k += width)
+                            std::copy(src + k, src + k + width, n.row(r0 + k / width) + c0);
+                        them.halos.complete();
+                    }, edge.data(), edge.size() * sizeof(T));
+                }
+            }
+        }
+    }
+
+    // The sending half of an exchange; the receiving half is wait_halos().
+    void begin_exchange() const { post_halos(); }
+
+    /**
+     * Waits for this exchange's halos, publishes the neighbours' activity
+     * they carried and enrolls for the next exchange before returning.
+     */
+    void wait_halos() const {
+        Local& me = mine();
+        me.halos.wait();
+        for (Block& b : me.blocks) {
+            b.neighbour_activity = b.incoming_activity;
+            b.incoming_activity = 0;
+        }
+        me.halos.enroll(me.expected_halos);
+    }
+
+    // A full, blocking exchange. Inside on_all_cores.
+    void exchange_halos() const {
+        begin_exchange();
+        wait_halos();
+    }
+
+    // Collective: runs f(block) for every block, on the core that owns it.
+    template <typename F>
+    void forall_blocks(F f) const {
+        const DistributedGrid g = *this;
+        Grappa::on_all_cores([g, f]{
+            for (Block& blk : g.mine().blocks) f(blk);
+        });
+    }
+
+    /**
+     * Collective: runs f(i, j, cell, block) for every cell on the core that
+     * owns it; block.at() reaches the neighbours, halo included.
+     */
+    template <typename F>
+    void forall_cells(F f) const {
+        forall_blocks([f](Block& blk) {
+            for (long i = blk.i0; i < blk.i0 + blk.rows; i++)
+                for (long j = blk.j0; j < blk.j0 + blk.cols; j++)
+                    f(i, j, blk.at(i, j), blk);
+        });
+    }
+
+    /**
+     * Inside on_all_cores: every core weighs its own blocks with
+     * weight(block) and sends the weights to every other core in one
+     * message, so each core returns the same table, block id -> weight.
+     * The messages point into this core's entries until they go out: the
+     * closing barrier, once every core has heard from all the others,
+     * keeps them alive until then.
+     */
+    template <typename F>
+    std::vector<double> gather_weights(F weight) const {
+        struct Entry { long id; double weight; };
+        Local& me = mine();
+        me.weights.assign(layout.blocks(), 0);
+        std::vector<Entry> entries;
+        for (Block& b : me.blocks) {
+            me.weights[b.id] = weight(b);
+            entries.push_back(Entry{ b.id, me.weights[b.id] });
+        }
+
+        me.transfers.enroll(Grappa::cores() - 1);
+        Grappa::barrier();
+        GlobalAddress<Local> dest = local;
+        for (Grappa::Core c = 0; c < Grappa::cores(); c++) {
+            if (c == Grappa::mycore()) continue;
+            Grappa::send_heap_message(c, [dest](void* payload, size_t size) {
+                Local& them = *dest.localize();
+                const Entry* e = (const Entry*) payload;
+                for (size_t k = 0; k < size / sizeof(Entry); k++) them.weights[e[k].id] = e[k].weight;
+                them.transfers.complete();
+            }, entries.data(), entries.size() * sizeof(Entry));
+        }
+        me.transfers.wait();
+        Grappa::barrier();
+        return me.weights;
+    }
+
+    /**
+     * Cuts the blocks, in id order, into ncores runs of about equal total
+     * weight: a block goes to the core its weight's midpoint falls in.
+     * Consecutive ids stay together, so most neighbours stay on one core.
+     */
+    static std::vector<Grappa::Core> balanced_owners(const std::vector<double>& weights, long ncores) {
+        double total = 0;
+        for (double w : weights) total += w;
+        std::vector<Grappa::Core> owners(weights.size(), 0);
+        double before = 0;
+        for (size_t b = 0; b < weights.size(); b++) {
+            double mid = total > 0 ? (before + weights[b] / 2) / total : (b + 0.5) / weights.size();
+            owners[b] = (Grappa::Core) std::min<long>(ncores - 1, (long)(mid * ncores));
+            before += weights[b];
+        }
+        return owners;
+    }
+
+    /**
+     * Inside on_all_cores, every core passing the same table: moves each
+     * block whose owner changes to its new owner, cells (halo included),
+     * activity and Info in one message. Returns the blocks this core sent.
+     * Each message points into its own buffer until it goes out; the
+     * closing barrier means every core has received its blocks, so all of
+     * them are out and the buffers can go.
+     */
+    long migrate(const std::vector<Grappa::Core>& owners) const {
+        struct Header { long id, rows, cols, i0, j0, activity, neighbour_activity; Info info; };
+        Local& me = mine();
+        const Grappa::Core self = Grappa::mycore();
+        long incoming = 0;
+        for (long b = 0; b < layout.blocks(); b++)
+            if (owners[b] == self && me.owners[b] != self) incoming++;
+        me.arrivals.clear();
+        me.transfers.enroll(incoming);
+        Grappa::barrier();
+
+        GlobalAddress<Local> dest = local;
+        std::vector<Block> staying;
+        std::vector<std::vector<char>> packed;      // one per block sent
+        packed.reserve(me.blocks.size());
+        long sent = 0;
+        for (Block& b : me.blocks) {
+            if (owners[b.id] == self) { staying.push_back(std::move(b)); continue; }
+            Header h{ b.id, b.rows, b.cols, b.i0, b.j0, b.activity, b.neighbour_activity, b.info };
+            packed.emplace_back(sizeof(Header) + b.cells.size() * sizeof(T));
+            std::vector<char>& p = packed.back();
+            memcpy(p.data(), &h, sizeof(Header));
+            memcpy(p.data() + sizeof(Header), b.cells.data(), b.cells.size() * sizeof(T));
+            Grappa::send_heap_message(owners[b.id], [dest](void* payload, size_t size) {
+                Local& them = *dest.localize();
+                Header h;
+                memcpy(&h, payload, sizeof(Header));
+                Block blk;
+                blk.id = h.id; blk.rows = h.rows; blk.cols = h.cols; blk.i0 = h.i0; blk.j0 = h.j0;
+                blk.activity = h.activity;
+                blk.neighbour_activity = h.neighbour_activity;
+                blk.info = h.info;
+                const T* cells = (const T*)((const char*) payload + sizeof(Header));
+                blk.cells.assign(cells, cells + (size - sizeof(Header)) / sizeof(T));
+                them.arrivals.push_back(std::move(blk));
+                them.transfers.complete();
+            }, p.data(), p.size());
+            sent++;
+        }
+        me.transfers.wait();
+        Grappa::barrier();
+
+        for (Block& b : me.arrivals) staying.push_back(std::move(b));
+        me.arrivals.clear();
+        std::sort(staying.begin(), staying.end(), [](const Block& a, const Block& b) { return a.id < b.id; });
+        me.blocks = std::move(staying);
+        me.index_of.assign(layout.blocks(), -1);
+        for (size_t k = 0; k < me.blocks.size(); k++) me.index_of[me.blocks[k].id] = k;
+        me.owners = owners;
+        // no exchange is in flight: trade the old enrollment for the new count
+        me.halos.complete(me.expected_halos);
+        count_halos(layout, me);
+        me.halos.enroll(me.expected_halos);
+        return sent;
+    }
+
+    // Halo messages a core expects per exchange, from its owned blocks' neighbours.
+    static void count_halos(const BlockLayout& l, Local& me) {
+        me.expected_halos = 0;
+        for (Block& b : me.blocks)
+            for (int dr = -1; dr <= 1; dr++)
+                for (int dc = -1; dc <= 1; dc++)
+                    if ((dr || dc) && l.neighbour(b.id, dr, dc) >= 0) me.expected_halos++;
+    }
+};
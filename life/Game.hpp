@@ -0,0 +1,242 @@
+#pragma once
+
+#include <Grappa.hpp>
+#include <algorithm>
+#include <cstring>
+#include <utility>
+#include <vector>
+
+#include "BandPool.hpp"
+#include "LineKernels.hpp"
+#include "Rule.hpp"
+#include "Stencil.hpp"
+
+// The byte-per-cell engines. The includer defines
+// enum class State : uint8_t { Dead, Alive }, as for HashLife::read_board().
+
+/**
+ * The board is cut into tiles of tile_cells x tile_lines cells. A tile is
+ * stepped only if it or one of its eight neighbours changed in the previous
+ * generation (or was edited with set()); any other tile cannot change, and
+ * `next` already holds it, since `next` is the previous generation and the
+ * tile was the same in it. Quiet regions of a board so cost one flag check.
+ *
+ * With a temporal block depth d > 1, a pass copies each active tile plus a
+ * ghost border d cells deep into per-band scratch, advances it d generations
+ * there (the valid region shrinking by one cell per generation) and writes
+ * the tile back, so one pass over memory covers d generations. The same
+ * skipping rule holds per pass: a tile equal to itself d generations ago, in
+ * a neighbourhood that is too, stays so for the next d.
+ */
+class Game {
+    static const long tile_cells = 256;    // along a line (i), so a tile row is contiguous
+    static const long tile_lines = 32;     // along j; also the deepest temporal block
+
+    Spaces::Domain grid_domain;
+    Spaces::Board<State> board;
+    Spaces::Board<State> next;     // the generation being computed; swapped with board every step
+    BandPool bands;         // band b always steps the same rows of tiles
+    LineKernel kernel;
+    int depth;              // generations per pass
+    Rule rule;
+    std::vector<std::vector<uint8_t>> scratch;   // per band: two generations of a padded tile
+
+    long tiles_x, tiles_y;
+    std::vector<uint8_t> changed;   // per tile: changed in the last pass, or edited since
+    int changed_depth = 0;          // the d `changed` was measured over
+    std::vector<uint8_t> active;    // per tile: to be stepped this pass
+    long active_tiles = 0;
+
+    long tile_of(long i, long j) const { return (i - 1) / tile_cells + tiles_x * ((j - 1) / tile_lines); }
+
+    // rows of tiles [first, second) stepped by band b
+    std::pair<long,long> tile_rows_of(int b) { return bands.band(0, tiles_y, b); }
+
+    std::pair<long,long> lines_of(int b) {
+        std::pair<long,long> rows = tile_rows_of(b);
+        const long last = grid_domain.y.upper - 1;
+        return std::make_pair(std::min(1 + rows.first * tile_lines, last),
+                              std::min(1 + rows.second * tile_lines, last));
+    }
+
+    // A tile is active if anything in its 3x3 neighbourhood of tiles changed.
+    void mark_active() {
+        active_tiles = 0;
+        for (long ty = 0; ty < tiles_y; ty++) {
+            for (long tx = 0; tx < tiles_x; tx++) {
+                uint8_t any = 0;
+                for (long y = std::max(ty - 1, 0L); y <= std::min(ty + 1, tiles_y - 1); y++)
+                    for (long x = std::max(tx - 1, 0L); x <= std::min(tx + 1, tiles_x - 1); x++)
+                        any |= changed[x + tiles_x * y];
+                active[tx + tiles_x * ty] = any;
+                active_tiles += any;
+            }
+        }
+    }
+
+public:
+    // A null kernel picks the widest one for the rule.
+    Game(size_t height, size_t width, int threads = 1,
+         LineKernel kernel_ = nullptr, int depth_ = 1, const Rule& rule_ = Rule()) :
+        grid_domain({ 
+            Spaces::Range(height + 2),
+            Spaces::Range(width + 2)
+        }),
+        board(grid_domain, false),
+        next(grid_domain, false),
+        bands(threads),
+        kernel(kernel_ ? kernel_ : select_line_kernel("auto", rule_)),
+        depth(std::max(1, std::min(depth_, (int) tile_lines))),
+        rule(rule_),
+        scratch(bands.size()),
+        tiles_x((height + tile_cells - 1) / tile_cells),
+        tiles_y((width + tile_lines - 1) / tile_lines),
+        changed(tiles_x * tiles_y, 1),
+        active(tiles_x * tiles_y, 1)
+    {
+        // first touch by the owning thread; the first and last band also take the border lines
+        const long Y = grid_domain.y.upper;
+        bands.run([this, Y](int b) {
+            std::pair<long,long> lines = lines_of(b);
+            if (b == 0) lines.first = 0;
+            if (b == bands.size() - 1) lines.second = Y;
+            board.clear_lines(lines.first, lines.second);
+            next.clear_lines(lines.first, lines.second);
+        });
+    }
+
+    bool alive(long i, long j) { return board.get(i,j) == State::Alive; }
+
+    void set(long i, long j, bool is_alive) {
+        board(i,j) = is_alive ? State::Alive : State::Dead;
+        changed[tile_of(i,j)] = 1;
+    }
+
+    // Brings cells (i, j) .. (i, j + n - 1) to life; a run crosses lines, so it is marked per tile.
+    void set_run(long i, long j, long n) {
+        for (long k = j; k < j + n; k++) board(i,k) = State::Alive;
+        for (long k = j; k < j + n; k += tile_lines - (k - 1) % tile_lines) changed[tile_of(i,k)] = 1;
+    }
+
+    // Tiles stepped by the last step(), out of tiles().
+    long stepped_tiles() const { return active_tiles; }
+    long tiles() const { return tiles_x * tiles_y; }
+
+    /**
+     * Cells with equal j are contiguous (see Board::project), so each line of
+     * a tile is stepped by one call of the line kernel on the tile's part of
+     * that line and of its two neighbour lines. Returns whether any cell of
+     * the tile changed.
+     */
+    bool step_tile(long tx, long ty) {
+        const long i_begin = 1 + tx * tile_cells;
+        const long i_end   = std::min(i_begin + tile_cells, (long) grid_domain.x.upper - 1);
+        const long j_begin = 1 + ty * tile_lines;
+        const long j_end   = std::min(j_begin + tile_lines, (long) grid_domain.y.upper - 1);
+
+        bool any = false;
+        for (long j = j_begin; j < j_end; j++) {
+            const uint8_t* now = (const uint8_t*) &board.get(0, j);
+            uint8_t* out = (uint8_t*) &next.get(0, j);
+            kernel((const uint8_t*) &board.get(0, j-1), now,
+                   (const uint8_t*) &board.get(0, j+1), out, i_begin, i_end, rule);
+            any = any || memcmp(now + i_begin, out + i_begin, i_end - i_begin) != 0;
+        }
+        return any;
+    }
+
+    /**
+     * Advances tile (tx, ty) d generations into `next` through `buf`. Every
+     * generation g steps the cells within d - g of the tile, clipped to the
+     * board interior; the border cells copied in stay dead.
+     */
+    bool step_tile_blocked(long tx, long ty, int d, std::vector<uint8_t>& buf) {
+        const long X = grid_domain.x.upper, Y = grid_domain.y.upper;
+        const long i_begin = 1 + tx * tile_cells, i_end = std::min(i_begin + tile_cells, X - 1);
+        const long j_begin = 1 + ty * tile_lines, j_end = std::min(j_begin + tile_lines, Y - 1);
+        const long i0 = std::max(i_begin - d, 0L), i1 = std::min(i_end + d, X);
+        const long j0 = std::max(j_begin - d, 0L), j1 = std::min(j_end + d, Y);
+        const long SX = i1 - i0, SY = j1 - j0;
+
+        buf.resize(2 * SX * SY);
+        uint8_t* gen[2] = { &buf[0], &buf[SX * SY] };
+        for (long j = j0; j < j1; j++) {
+            const uint8_t* line = (const uint8_t*) &board.get(i0, j);
+            std::copy(line, line + SX, gen[0] + (j - j0) * SX);
+            std::copy(line, line + SX, gen[1] + (j - j0) * SX);
+        }
+
+        for (int g = 1; g <= d; g++) {
+            const uint8_t* from = gen[(g - 1) % 2];
+            uint8_t* to = gen[g % 2];
+            const long reach = d - g;
+            const long ib = std::max(i_begin - reach, 1L) - i0, ie = std::min(i_end + reach, X - 1) - i0;
+            const long jb = std::max(j_begin - reach, 1L), je = std::min(j_end + reach, Y - 1);
+            for (long j = jb; j < je; j++) {
+                const long l = j - j0;
+                kernel(from + (l - 1) * SX, from + l * SX, from + (l + 1) * SX, to + l * SX, ib, ie, rule);
+            }
+        }
+
+        bool any = false;
+        const uint8_t* result = gen[d % 2];
+        for (long j = j_begin; j < j_end; j++) {
+            const uint8_t* now = (const uint8_t*) &board.get(i_begin, j);
+            const uint8_t* src = result + (j - j0) * SX + (i_begin - i0);
+            std::copy(src, src + (i_end - i_begin), (uint8_t*) &next.get(i_begin, j));
+            any = any || memcmp(now, src, i_end - i_begin) != 0;
+        }
+        return any;
+    }
+
+    // One pass of d generations: every band steps the active tiles of its rows, then the buffers swap.
+    void pass(int d) {
+        // a tile equal to itself d' generations ago may still change over d:
+        // flags from a pass of another depth say nothing, so step everything
+        if (d != changed_depth) std::fill(changed.begin(), changed.end(), 1);
+        changed_depth = d;
+        mark_active();
+
+        // the outer ring of grid_domain is a dead border, never stepped
+        bands.run([this, d](int b) {
+            std::pair<long,long> rows = tile_rows_of(b);
+            for (long ty = rows.first; ty < rows.second; ty++) {
+                for (long tx = 0; tx < tiles_x; tx++) {
+                    long t = tx + tiles_x * ty;
+                    changed[t] = active[t] &&
+                        (d == 1 ? step_tile(tx, ty) : step_tile_blocked(tx, ty, d, scratch[b]));
+                }
+            }
+        });
+
+        board.swap(next);
+        DVLOG(2) << "stepped " << active_tiles << " of " << tiles() << " tiles, " << d << " generations";
+    }
+
+    // Advances `generations` generations in passes of up to `depth`.
+    void step(long generations = 1) {
+        while (generations > 0) {
+            int d = (int) std::min<long>(generations, depth);
+            pass(d);
+            generations -= d;
+        }
+    }
+};
+
+/**
+ * Life on the generic stencil engine: the line kernels as a radius-1
+ * update of TiledStencil, which tiles and threads them like Game but steps
+ * every cell every generation.
+ */
+class StencilGame {
+    TiledStencil<LineKernelUpdate<State>> stencil;
+
+public:
+    StencilGame(long height, long width, int threads, LineKernel kernel, const Rule& rule) :
+        stencil(height, width, LineKernelUpdate<State>{ kernel, rule }, threads, State::Dead) {}
+
+    bool alive(long i, long j) { return stencil.get(i, j) == State::Alive; }
+    void set(long i, long j, bool is_alive) { stencil.set(i, j, is_alive ? State::Alive : State::Dead); }
+    void set_run(long i, long j, long n) { for (long k = j; k < j + n; k++) stencil.set(i, k, State::Alive); }
+    void step(long generations = 1) { stencil.step(generations); }
+};
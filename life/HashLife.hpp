@@ -0,0 +1,362 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdlib>
+#include <cstdint>
+#include <functional>
+#include <stdexcept>
+#include <unordered_map>
+#include <vector>
+
+#include "Rule.hpp"
+
+
+/**
+ * Hashlife (Gosper): the plane is a quadtree whose nodes are canonical, so
+ * equal squares anywhere in space or time are one node, and every node
+ * memoizes its centre half advanced 2^j generations. Repetitive patterns
+ * then advance 2^j generations in time roughly proportional to the number
+ * of distinct squares, not to cells x generations.
+ *
+ * Coordinates follow Game, but the plane is unbounded: results equal Game's
+ * as long as the pattern stays clear of Game's dead border. The root is
+ * always centred on (0, 0). Nodes live in one table bounded by `max_nodes`;
+ * between jumps, nodes unreachable from the root are collected when the
+ * table outgrows it.
+ */
+class HashLife {
+    typedef uint32_t Id;
+    static const Id none = ~0u;
+
+    struct Node {
+        Id nw, ne, sw, se;          // quadrants; unused for the two leaves
+        Id next = none;             // memo: centre half advanced 2^next_j generations
+        uint64_t population;
+        uint8_t level;              // 2^level x 2^level cells
+        int8_t next_j = -1;
+        bool marked = false;
+    };
+
+    struct Key {
+        Id nw, ne, sw, se;
+        bool operator==(const Key& o) const { return nw == o.nw && ne == o.ne && sw == o.sw && se == o.se; }
+    };
+    struct KeyHash {
+        size_t operator()(const Key& k) const {
+            uint64_t h = k.nw;
+            h = h * 0x9E3779B97F4A7C15ULL + k.ne;
+            h = h * 0x9E3779B97F4A7C15ULL + k.sw;
+            h = h * 0x9E3779B97F4A7C15ULL + k.se;
+            return h ^ (h >> 29);
+        }
+    };
+
+    std::vector<Node> nodes;                      // ids 0 and 1 are the dead and live leaves
+    std::vector<Id> free_ids;
+    std::unordered_map<Key, Id, KeyHash> canonical;
+    std::vector<Id> empties;                      // empty node of every level
+    size_t max_nodes;
+    Rule rule;
+
+    Id root;
+    uint64_t generations = 0;
+
+    const Node& at(Id n) const { return nodes[n]; }
+
+    Id join(Id nw, Id ne, Id sw, Id se) {
+        Key key = { nw, ne, sw, se };
+        auto found = canonical.find(key);
+        if (found != canonical.end()) return found->second;
+
+        Node n;
+        n.nw = nw; n.ne = ne; n.sw = sw; n.se = se;
+        n.level = at(nw).level + 1;
+        n.population = at(nw).population + at(ne).population + at(sw).population + at(se).population;
+
+        Id id;
+        if (free_ids.empty()) {
+            id = nodes.size();
+            nodes.push_back(n);
+        } else {
+            id = free_ids.back();
+            free_ids.pop_back();
+            nodes[id] = n;
+        }
+        canonical.emplace(key, id);
+        return id;
+    }
+
+    Id empty(int level) {
+        while ((int) empties.size() <= level) {
+            Id e = empties.back();
+            empties.push_back(join(e, e, e, e));
+        }
+        return empties[level];
+    }
+
+    // The centred node one level down.
+    Id centre(Id n) {
+        const Node& m = at(n);
+        return join(at(m.nw).se, at(m.ne).sw, at(m.sw).ne, at(m.se).nw);
+    }
+
+    Id centre_horizontal(Id w, Id e) { return join(at(w).ne, at(e).nw, at(w).se, at(e).sw); }
+    Id centre_vertical(Id n, Id s)   { return join(at(n).sw, at(n).se, at(s).nw, at(s).ne); }
+
+    // Level 2 (4x4) to its centre 2x2 one generation later, cell by cell.
+    Id step_level2(Id n) {
+        bool cell[4][4];
+        const Node& m = at(n);
+        Id quads[2][2] = { { m.nw, m.ne }, { m.sw, m.se } };
+        for (int qi = 0; qi < 2; qi++)
+            for (int qj = 0; qj < 2; qj++) {
+                const Node& q = at(quads[qi][qj]);
+                cell[2*qi][2*qj]     = q.nw == 1;  cell[2*qi][2*qj + 1]     = q.ne == 1;
+                cell[2*qi + 1][2*qj] = q.sw == 1;  cell[2*qi + 1][2*qj + 1] = q.se == 1;
+            }
+
+        Id out[2][2];
+        for (int i = 1; i <= 2; i++)
+            for (int j = 1; j <= 2; j++) {
+                int num_alive = 0;
+                for (int di = -1; di <= 1; di++)
+                    for (int dj = -1; dj <= 1; dj++)
+                        num_alive += (di || dj) && cell[i + di][j + dj];
+                out[i-1][j-1] = rule.next[cell[i][j]][num_alive];
+            }
+        return join(out[0][0], out[0][1], out[1][0], out[1][1]);
+    }
+
+    /**
+     * The centre half of node n (level k >= 2) advanced 2^j generations,
+     * j <= k - 2. Nine overlapping sub-squares are advanced (by 2^(k-3)
+     * generations at full speed, not at all otherwise), regrouped into four,
+     * and those advanced by the rest.
+     */
+    Id successor(Id n, int j) {
+        const Node& m = at(n);
+        int k = m.level;
+        if (m.population == 0) return empty(k - 1);
+        if (m.next != none && m.next_j == j) return m.next;
+
+        Id result;
+        if (k == 2) {
+            result = step_level2(n);
+        } else {
+            Id nw = m.nw, ne = m.ne, sw = m.sw, se = m.se;
+            Id sub[3][3] = {
+                { nw,                        centre_horizontal(nw, ne), ne                      },
+                { centre_vertical(nw, sw),   centre(n),                 centre_vertical(ne, se) },
+                { sw,                        centre_horizontal(sw, se), se                      },
+            };
+            bool full = j == k - 2;
+            for (int a = 0; a < 3; a++)
+                for (int b = 0; b < 3; b++)
+                    sub[a][b] = full ? successor(sub[a][b], k - 3) : centre(sub[a][b]);
+
+            int rest = full ? k - 3 : j;
+            result = join(successor(join(sub[0][0], sub[0][1], sub[1][0], sub[1][1]), rest),
+                          successor(join(sub[0][1], sub[0][2], sub[1][1], sub[1][2]), rest),
+                          successor(join(sub[1][0], sub[1][1], sub[2][0], sub[2][1]), rest),
+                          successor(join(sub[1][1], sub[1][2], sub[2][1], sub[2][2]), rest));
+        }
+
+        // `m` may dangle: join() can grow the node table
+        nodes[n].next = result;
+        nodes[n].next_j = j;
+        return result;
+    }
+
+    int level() const { return at(root).level; }
+    long half() const { return 1L << (level() - 1); }
+
+    // Doubles the root around the same centre.
+    void expand() {
+        const Node r = at(root);
+        Id e = empty(r.level - 1);
+        root = join(join(e, e, e, r.nw), join(e, e, r.ne, e),
+                    join(e, r.sw, e, e), join(r.se, e, e, e));
+    }
+
+    // True if every live cell is in the centre quarter (by width) of the root.
+    bool centred() {
+        if (level() < 3) return false;
+        const Node r = at(root);
+        Id inner = join(at(at(r.nw).se).se, at(at(r.ne).sw).sw,
+                        at(at(r.sw).ne).ne, at(at(r.se).nw).nw);
+        return at(inner).population == r.population;
+    }
+
+    bool contains(long i, long j) const { return i >= -half() && i < half() && j >= -half() && j < half(); }
+
+    // Node n with the cell at (i, j), relative to its top-left corner, set to `alive`.
+    Id with_cell(Id n, long i, long j, bool alive) {
+        const Node m = at(n);
+        if (m.level == 0) return alive ? 1 : 0;
+        long h = 1L << (m.level - 1);
+        if (i < h) {
+            if (j < h) return join(with_cell(m.nw, i, j, alive), m.ne, m.sw, m.se);
+            return join(m.nw, with_cell(m.ne, i, j - h, alive), m.sw, m.se);
+        }
+        if (j < h) return join(m.nw, m.ne, with_cell(m.sw, i - h, j, alive), m.se);
+        return join(m.nw, m.ne, m.sw, with_cell(m.se, i - h, j - h, alive));
+    }
+
+    // Calls f(i, j) for every live cell of node n, whose top-left cell is (i0, j0).
+    void visit(Id n, long i0, long j0, const std::function<void(long,long)>& f) const {
+        const Node& m = at(n);
+        if (m.population == 0) return;
+        if (m.level == 0) { f(i0, j0); return; }
+        long h = 1L << (m.level - 1);
+        visit(m.nw, i0, j0, f);
+        visit(m.ne, i0, j0 + h, f);
+        visit(m.sw, i0 + h, j0, f);
+        visit(m.se, i0 + h, j0 + h, f);
+    }
+
+    /**
+     * Square of 2^level cells with top-left (i0, j0), read through alive(i, j)
+     * where it overlaps the region [ib, ie) x [jb, je) and empty elsewhere.
+     */
+    Id build(long i0, long j0, int level, const std::function<bool(long,long)>& alive,
+             long ib, long ie, long jb, long je) {
+        long size = 1L << level;
+        if (i0 >= ie || j0 >= je || i0 + size <= ib || j0 + size <= jb) return empty(level);
+        if (level == 0) return alive(i0, j0) ? 1 : 0;
+        long h = size / 2;
+        return join(build(i0,     j0,     level - 1, alive, ib, ie, jb, je),
+                    build(i0,     j0 + h, level - 1, alive, ib, ie, jb, je),
+                    build(i0 + h, j0,     level - 1, alive, ib, ie, jb, je),
+                    build(i0 + h, j0 + h, level - 1, alive, ib, ie, jb, je));
+    }
+
+    // Mark-and-sweep from the root; memos pointing at collected nodes are dropped.
+    void collect() {
+        std::vector<Id> stack(empties.begin(), empties.end());
+        stack.push_back(root);
+        while (!stack.empty()) {
+            Id n = stack.back();
+            stack.pop_back();
+            if (nodes[n].marked) continue;
+            nodes[n].marked = true;
+            if (nodes[n].level > 0) {
+                stack.push_back(nodes[n].nw); stack.push_back(nodes[n].ne);
+                stack.push_back(nodes[n].sw); stack.push_back(nodes[n].se);
+            }
+        }
+
+        size_t before = canonical.size();
+        for (Id n = 2; n < nodes.size(); n++) {
+            Node& m = nodes[n];
+            if (m.level == 0) continue;   // already free
+            if (!m.marked) {
+                canonical.erase(Key{ m.nw, m.ne, m.sw, m.se });
+                m.level = 0;
+                m.population = 0;
+                free_ids.push_back(n);
+            } else if (m.next != none && !nodes[m.next].marked) {
+                m.next = none;
+            }
+        }
+        for (Node& m : nodes) m.marked = false;
+        DVLOG(2) << "hashlife gc: " << before << " -> " << canonical.size() << " nodes";
+    }
+
+public:
+    HashLife(size_t max_nodes_ = 1 << 22, const Rule& rule_ = Rule()) : max_nodes(max_nodes_), rule(rule_) {
+        // an empty square must stay empty for the empty-node shortcut and the unbounded plane
+        if (rule.birth & 1) throw std::runtime_error("hashlife cannot run a B0 rule");
+        Node leaf;
+        leaf.level = 0;
+        leaf.nw = leaf.ne = leaf.sw = leaf.se = none;
+        leaf.population = 0;
+        nodes.push_back(leaf);
+        leaf.population = 1;
+        nodes.push_back(leaf);
+
+        empties.push_back(0);
+        root = empty(3);
+    }
+
+    bool alive(long i, long j) const {
+        if (!contains(i, j)) return false;
+        Id n = root;
+        long r = i + half(), c = j + half();
+        while (at(n).level > 0) {
+            long h = 1L << (at(n).level - 1);
+            const Node& m = at(n);
+            if (r < h) n = c < h ? m.nw : m.ne;
+            else       n = c < h ? m.sw : m.se;
+            if (r >= h) r -= h;
+            if (c >= h) c -= h;
+        }
+        return n == 1;
+    }
+
+    void set(long i, long j, bool is_alive) {
+        while (!contains(i, j)) expand();
+        root = with_cell(root, i + half(), j + half(), is_alive);
+    }
+
+    void set_run(long i, long j, long n) {
+        for (long k = j; k < j + n; k++) set(i, k, true);
+    }
+
+    uint64_t population() const { return at(root).population; }
+    uint64_t generation() const { return generations; }
+    size_t cached_nodes() const { return canonical.size(); }
+
+    // Advances 2^j generations in one successor call.
+    void jump(int j) {
+        if (canonical.size() > max_nodes) collect();
+        while (level() < j + 2 || !centred()) expand();
+        expand();   // light speed: 2^j more cells on every side still land in the result
+        root = successor(root, j);
+        generations += 1ULL << j;
+    }
+
+    /**
+     * Advances `n` generations as a sum of powers of two. The memo of a node
+     * holds one jump size, so repeated steps of the same power of two are the
+     * ones that hit it.
+     */
+    void step(uint64_t n = 1) {
+        for (int j = 0; n; j++, n >>= 1)
+            if (n & 1) jump(j);
+    }
+
+    // Calls f(i, j) for every live cell.
+    void for_each_alive(const std::function<void(long,long)>& f) const {
+        visit(root, -half(), -half(), f);
+    }
+
+    /**
+     * Replaces the pattern by the interior of a Spaces::Board (its outer ring
+     * is the dead border) and restarts the generation count.
+     */
+    template <typename Board>
+    void read_board(Board& board) {
+        const long i0 = board.domain.x.lower + 1, i1 = board.domain.x.upper - 1;
+        const long j0 = board.domain.y.lower + 1, j1 = board.domain.y.upper - 1;
+        long reach = std::max(std::max(std::abs(i0), std::abs(i1)), std::max(std::abs(j0), std::abs(j1)));
+        int lvl = 3;
+        while ((1L << (lvl - 1)) < reach) lvl++;
+
+        long h = 1L << (lvl - 1);
+        root = build(-h, -h, lvl, [&](long i, long j) {
+            return board.get(i,j) == State::Alive;
+        }, i0, i1, j0, j1);
+        generations = 0;
+    }
+
+    // Writes the pattern into the interior of a Spaces::Board; cells outside it are dropped.
+    template <typename Board>
+    void write_board(Board& board) const {
+        const long i0 = board.domain.x.lower + 1, i1 = board.domain.x.upper - 1;
+        const long j0 = board.domain.y.lower + 1, j1 = board.domain.y.upper - 1;
+        board.clear_lines(board.domain.y.lower, board.domain.y.upper);
+        for_each_alive([&](long i, long j) {
+            if (i >= i0 && i < i1 && j >= j0 && j < j1) board.get(i,j) = State::Alive;
+        });
+    }
+};
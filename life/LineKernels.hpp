@@ -0,0 +1,158 @@
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+#include "Rule.hpp"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define LIFE_X86_KERNELS 1
+#endif
+
+
+/**
+ * Stepping kernels for byte-per-cell boards (0 = dead, 1 = alive). A kernel
+ * computes cells [begin, end) of `out` from the line itself (`mid`) and the
+ * lines on either side of it; cells begin - 1 and end are read, so the
+ * caller keeps a dead border around the lines. The new state of a cell is
+ * looked up in the rule's tables.
+ */
+typedef void (*LineKernel)(const uint8_t* west, const uint8_t* mid, const uint8_t* east,
+                           uint8_t* out, long begin, long end, const Rule& rule);
+
+// Scalar sliding window: one new cross-sum per cell.
+void step_line_scalar(const uint8_t* west, const uint8_t* mid, const uint8_t* east,
+                      uint8_t* out, long begin, long end, const Rule& rule)
+{
+    auto cross = [=](long i) { return west[i] + mid[i] + east[i]; };
+
+    int behind = cross(begin - 1), here = cross(begin);
+    for (long i = begin; i < end; i++) {
+        int ahead = cross(i+1);
+        int is_alive = mid[i];
+        int num_alive = behind + here + ahead - is_alive;
+        out[i] = rule.next[is_alive][num_alive];
+        behind = here;
+        here = ahead;
+    }
+}
+
+// The scalar kernel for a rule known at compile time; the `rule` argument is ignored.
+template <typename R>
+void step_line_fixed(const uint8_t* west, const uint8_t* mid, const uint8_t* east,
+                     uint8_t* out, long begin, long end, const Rule&)
+{
+    auto cross = [=](long i) { return west[i] + mid[i] + east[i]; };
+
+    int behind = cross(begin - 1), here = cross(begin);
+    for (long i = begin; i < end; i++) {
+        int ahead = cross(i+1);
+        int is_alive = mid[i];
+        out[i] = R::next(is_alive, behind + here + ahead - is_alive);
+        behind = here;
+        here = ahead;
+    }
+}
+
+#ifdef LIFE_X86_KERNELS
+
+__attribute__((target("avx2")))
+inline __m256i load32(const uint8_t* p) { return _mm256_loadu_si256((const __m256i*) p); }
+
+__attribute__((target("avx512f,avx512bw")))
+inline __m512i load64(const uint8_t* p) { return _mm512_loadu_si512((const void*) p); }
+
+// 32 cells per iteration: eight shifted byte loads summed, the rule tables applied as byte shuffles.
+__attribute__((target("avx2")))
+void step_line_avx2(const uint8_t* west, const uint8_t* mid, const uint8_t* east,
+                    uint8_t* out, long begin, long end, const Rule& rule)
+{
+    const __m256i one = _mm256_set1_epi8(1);
+    const __m256i births   = _mm256_broadcastsi128_si256(_mm_load_si128((const __m128i*) rule.next[0]));
+    const __m256i survivals = _mm256_broadcastsi128_si256(_mm_load_si128((const __m128i*) rule.next[1]));
+    long i = begin;
+    for (; i + 32 <= end; i += 32) {
+        __m256i sum = _mm256_add_epi8(
+            _mm256_add_epi8(_mm256_add_epi8(load32(west + i - 1), load32(west + i)),
+                            _mm256_add_epi8(load32(west + i + 1), load32(mid + i - 1))),
+            _mm256_add_epi8(_mm256_add_epi8(load32(mid + i + 1), load32(east + i - 1)),
+                            _mm256_add_epi8(load32(east + i), load32(east + i + 1))));
+        __m256i alive = _mm256_cmpeq_epi8(load32(mid + i), one);
+        __m256i next = _mm256_blendv_epi8(_mm256_shuffle_epi8(births, sum),
+                                          _mm256_shuffle_epi8(survivals, sum), alive);
+        _mm256_storeu_si256((__m256i*) (out + i), next);
+    }
+    step_line_scalar(west, mid, east, out, i, end, rule);
+}
+
+// 64 cells per iteration; a live-cell mask picks between the two shuffled tables.
+__attribute__((target("avx512f,avx512bw")))
+void step_line_avx512(const uint8_t* west, const uint8_t* mid, const uint8_t* east,
+                      uint8_t* out, long begin, long end, const Rule& rule)
+{
+    const __m512i one = _mm512_set1_epi8(1);
+    const __m512i births    = _mm512_broadcast_i32x4(_mm_load_si128((const __m128i*) rule.next[0]));
+    const __m512i survivals = _mm512_broadcast_i32x4(_mm_load_si128((const __m128i*) rule.next[1]));
+    long i = begin;
+    for (; i + 64 <= end; i += 64) {
+        __m512i sum = _mm512_add_epi8(
+            _mm512_add_epi8(_mm512_add_epi8(load64(west + i - 1), load64(west + i)),
+                            _mm512_add_epi8(load64(west + i + 1), load64(mid + i - 1))),
+            _mm512_add_epi8(_mm512_add_epi8(load64(mid + i + 1), load64(east + i - 1)),
+                            _mm512_add_epi8(load64(east + i), load64(east + i + 1))));
+        __mmask64 alive = _mm512_cmpeq_epi8_mask(load64(mid + i), one);
+        __m512i next = _mm512_mask_blend_epi8(alive, _mm512_shuffle_epi8(births, sum),
+                                              _mm512_shuffle_epi8(survivals, sum));
+        _mm512_storeu_si512((void*) (out + i), next);
+    }
+    step_line_scalar(west, mid, east, out, i, end, rule);
+}
+
+#endif
+
+/**
+ * The widest kernel this CPU supports: "auto", or "avx512" / "avx2" /
+ * "scalar" to cap the choice (an unsupported request falls back further).
+ * A scalar Conway run gets the compile-time kernel. `chosen` receives the
+ * name of the kernel picked.
+ */
+LineKernel select_line_kernel(const std::string& wanted, const Rule& rule = Rule(),
+                              std::string* chosen = nullptr) {
+    std::string name = "scalar";
+    LineKernel kernel = step_line_scalar;
+    if (rule == Conway::rule()) {
+        name = "scalar-b3s23";
+        kernel = step_line_fixed<Conway>;
+    }
+#ifdef LIFE_X86_KERNELS
+    __builtin_cpu_init();
+    bool any = wanted == "auto";
+    if ((any || wanted == "avx512") && __builtin_cpu_supports("avx512bw")) {
+        name = "avx512"; kernel = step_line_avx512;
+    } else if ((any || wanted == "avx512" || wanted == "avx2") && __builtin_cpu_supports("avx2")) {
+        name = "avx2";   kernel = step_line_avx2;
+    }
+#endif
+    if (chosen) *chosen = name;
+    return kernel;
+}
+
+/**
+ * A line kernel and its rule as a stencil update of radius 1 (see
+ * Stencil.hpp), for any one-byte cell type.
+ */
+template <typename C>
+struct LineKernelUpdate {
+    typedef C Cell;
+    static const int radius = 1;
+    static_assert(sizeof(Cell) == 1, "line kernels step one-byte cells");
+
+    LineKernel kernel;
+    Rule rule;
+
+    void operator()(const Cell* const* lines, Cell* out, long begin, long end) const {
+        kernel((const uint8_t*) lines[0], (const uint8_t*) lines[1], (const uint8_t*) lines[2],
+               (uint8_t*) out, begin, end, rule);
+    }
+};
@@ -0,0 +1,275 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <stdexcept>
+#include <string>
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+
+// A read-only mapping of a whole file, read front to back.
+class MappedFile {
+    const char* bytes = nullptr;
+    size_t length = 0;
+
+public:
+    MappedFile(const std::string& path) {
+        int fd = open(path.c_str(), O_RDONLY);
+        if (fd < 0) throw std::runtime_error("cannot open " + path);
+        struct stat st;
+        if (fstat(fd, &st) != 0) { close(fd); throw std::runtime_error("cannot stat " + path); }
+        length = st.st_size;
+        if (length > 0) {
+            void* p = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+            if (p == MAP_FAILED) { close(fd); throw std::runtime_error("cannot map " + path); }
+            madvise(p, length, MADV_SEQUENTIAL);
+            bytes = (const char*) p;
+        }
+        close(fd);
+    }
+    ~MappedFile() { if (bytes) munmap((void*) bytes, length); }
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    const char* begin() const { return bytes; }
+    const char* end() const { return bytes + length; }
+};
+
+/**
+ * A Life pattern in RLE, plaintext (.cells) or Life 1.06 format, read in
+ * place from a mapping of the file. Live cells come out as runs along a
+ * row, in pattern coordinates: rows and cols from 0 at the top-left of the
+ * pattern's extent, so placing it is one offset per run.
+ */
+class Pattern {
+public:
+    enum Format { RLE, Plaintext, Life106 };
+    typedef std::function<void(long row, long col, long length)> RunSink;
+
+private:
+    MappedFile file;
+    std::string path;
+    Format fmt;
+    long nrows = 0, ncols = 0;
+    long row0 = 0, col0 = 0;    // Life 1.06: smallest coordinates in the file
+
+    static const char* next_line(const char* p, const char* end) {
+        const char* nl = (const char*) memchr(p, '\n', end - p);
+        return nl ? nl + 1 : end;
+    }
+
+    static bool starts_with(const char* p, const char* end, const char* prefix) {
+        size_t n = strlen(prefix);
+        return (size_t)(end - p) >= n && memcmp(p, prefix, n) == 0;
+    }
+
+    static long parse_long(const char*& p, const char* end) {
+        while (p < end && (*p == ' ' || *p == '\t')) p++;
+        bool negative = p < end && *p == '-';
+        if (negative || (p < end && *p == '+')) p++;
+        if (p == end || *p < '0' || *p > '9') throw std::runtime_error("expected a number");
+        long v = 0;
+        while (p < end && *p >= '0' && *p <= '9') v = 10 * v + (*p++ - '0');
+        return negative ? -v : v;
+    }
+
+    // Reads the RLE header line "x = m, y = n[, rule = ...]"; returns the start of the cell data.
+    const char* rle_header(long* rows, long* cols) const {
+        const char* p = file.begin();
+        const char* end = file.end();
+        while (p < end && (*p == '#' || *p == '\n' || *p == '\r')) p = next_line(p, end);
+        const char* line_end = next_line(p, end);
+        for (const char* q = p; q < line_end; q++) {
+            if ((*q == 'x' || *q == 'y') && q + 1 < line_end) {
+                const char* v = q + 1;
+                while (v < line_end && (*v == ' ' || *v == '=')) v++;
+                if (v < line_end && *v >= '0' && *v <= '9')
+                    *(*q == 'x' ? cols : rows) = parse_long(v, line_end);
+            }
+            if (*q == 'r') break;   // rule = ...: letters from here on are not x/y
+        }
+        return line_end;
+    }
+
+    void measure() {
+        const char* end = file.end();
+        if (fmt == RLE) {
+            rle_header(&nrows, &ncols);
+        } else if (fmt == Plaintext) {
+            for (const char* p = file.begin(); p < end; ) {
+                const char* line_end = next_line(p, end);
+                if (*p != '!') {
+                    const char* q = line_end;
+                    while (q > p && (q[-1] == '\n' || q[-1] == '\r')) q--;
+                    ncols = std::max(ncols, (long)(q - p));
+                    nrows++;
+                }
+                p = line_end;
+            }
+        } else {
+            long rmin = 0, rmax = -1, cmin = 0, cmax = -1;
+            bool any = false;
+            for_each_106([&](long row, long col) {
+                if (!any) { rmin = rmax = row; cmin = cmax = col; any = true; }
+                rmin = std::min(rmin, row); rmax = std::max(rmax, row);
+                cmin = std::min(cmin, col); cmax = std::max(cmax, col);
+            });
+            row0 = rmin; col0 = cmin;
+            nrows = rmax - rmin + 1;
+            ncols = cmax - cmin + 1;
+        }
+    }
+
+    template <typename F>
+    void for_each_106(F f) const {
+        const char* end = file.end();
+        for (const char* p = file.begin(); p < end; ) {
+            const char* line_end = next_line(p, end);
+            if (*p != '#' && *p != '\n' && *p != '\r') {
+                long x = parse_long(p, line_end);
+                long y = parse_long(p, line_end);
+                f(y, x);
+            }
+            p = line_end;
+        }
+    }
+
+public:
+    Pattern(const std::string& path_) : file(path_), path(path_) {
+        const char* p = file.begin();
+        const char* end = file.end();
+        if (starts_with(p, end, "#Life 1.06")) {
+            fmt = Life106;
+        } else {
+            // RLE if the first line that is not a # comment is the "x = ..." header
+            while (p < end && *p == '#') p = next_line(p, end);
+            while (p < end && (*p == ' ' || *p == '\t')) p++;
+            fmt = (p < end && *p == 'x') ? RLE : Plaintext;
+        }
+        try {
+            measure();
+        } catch (std::runtime_error& e) {
+            throw std::runtime_error(path + ": " + e.what());
+        }
+    }
+
+    Format format() const { return fmt; }
+    long rows() const { return nrows; }
+    long cols() const { return ncols; }
+
+    // Calls emit for every run of live cells; returns the number of live cells.
+    long runs(const RunSink& emit) const {
+        long cells = 0;
+        const char* end = file.end();
+
+        if (fmt == RLE) {
+            long unused_rows, unused_cols;
+            const char* p = rle_header(&unused_rows, &unused_cols);
+            long row = 0, col = 0;
+            while (p < end && *p != '!') {
+                long count = 1;
+                if (*p >= '0' && *p <= '9') {
+                    count = parse_long(p, end);
+                    while (p < end && (*p == '\n' || *p == '\r' || *p == ' ')) p++;
+                }
+                if (p == end) break;
+                char tag = *p++;
+                if (tag == '$') {
+                    row += count; col = 0;
+                } else if (tag == 'b' || tag == '.') {
+                    col += count;
+                } else if ((tag >= 'a' && tag <= 'z') || (tag >= 'A' && tag <= 'Z')) {
+                    // 'o' and every multi-state letter count as alive
+                    emit(row, col, count);
+                    col += count;
+                    cells += count;
+                } else if (tag != ' ' && tag != '\n' && tag != '\r' && tag != '\t') {
+                    throw std::runtime_error(path + ": unexpected '" + std::string(1, tag) + "' in RLE data");
+                }
+            }
+        } else if (fmt == Plaintext) {
+            long row = 0;
+            for (const char* p = file.begin(); p < end; ) {
+                const char* line_end = next_line(p, end);
+                if (*p == '!') { p = line_end; continue; }
+                for (const char* q = p; q < line_end; ) {
+                    if (*q == 'O' || *q == '*') {
+                        const char* r = q;
+                        while (r < line_end && (*r == 'O' || *r == '*')) r++;
+                        emit(row, q - p, r - q);
+                        cells += r - q;
+                        q = r;
+                    } else {
+                        q++;
+                    }
+                }
+                row++;
+                p = line_end;
+            }
+        } else {
+            for_each_106([&](long row, long col) {
+                emit(row - row0, col - col0, 1);
+                cells++;
+            });
+        }
+        return cells;
+    }
+};
+
+/**
+ * Places a pattern file centred on an engine's [1, height] x [1, width]
+ * board, one set_run() per run; cells falling off the board are dropped.
+ * Returns the number of live cells placed.
+ */
+template <typename G>
+long place_pattern(G& game, const std::string& path, long height, long width) {
+    Pattern pattern(path);
+    const long i0 = 1 + std::max(0L, (height - pattern.rows()) / 2);
+    const long j0 = 1 + std::max(0L, (width - pattern.cols()) / 2);
+    long placed = 0;
+    pattern.runs([&](long row, long col, long length) {
+        long i = i0 + row;
+        long j_begin = std::max(j0 + col, 1L), j_end = std::min(j0 + col + length, width + 1);
+        if (i < 1 || i > height || j_begin >= j_end) return;
+        game.set_run(i, j_begin, j_end - j_begin);
+        placed += j_end - j_begin;
+    });
+    return placed;
+}
+
+/**
+ * A random soup: cell (i, j) is alive with probability `density`, decided
+ * by a hash of (seed, i, j) alone, so any thread or core can fill any part
+ * of a board and every engine gets the same one.
+ */
+inline bool soup_alive(uint64_t seed, long i, long j, double density) {
+    uint64_t x = seed * 0x9e3779b97f4a7c15ULL ^ ((uint64_t) i << 32) ^ (uint64_t) j;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    x ^= x >> 31;
+    return (double)(x >> 11) < density * 9007199254740992.0;
+}
+
+// Fills an engine's [1, height] x [1, width] board with a soup, one set_run() per run; returns the live cells.
+template <typename G>
+long place_soup(G& game, long height, long width, double density, uint64_t seed) {
+    long placed = 0;
+    for (long i = 1; i <= height; i++) {
+        for (long j = 1; j <= width; ) {
+            if (!soup_alive(seed, i, j, density)) { j++; continue; }
+            long end = j + 1;
+            while (end <= width && soup_alive(seed, i, end, density)) end++;
+            game.set_run(i, j, end - j);
+            placed += end - j;
+            j = end;
+        }
+    }
+    return placed;
+}
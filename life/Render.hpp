@@ -0,0 +1,126 @@
+#pragma once
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+
+// Terminal size in characters; 80 x 24 when stdout is not a terminal.
+inline void terminal_size(long* rows, long* cols) {
+    struct winsize ws;
+    if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == 0 && ws.ws_row > 0 && ws.ws_col > 0) {
+        *rows = ws.ws_row;
+        *cols = ws.ws_col;
+    } else {
+        *rows = 24;
+        *cols = 80;
+    }
+}
+
+// Which block a cell falls in; plain data, so it can travel in a lambda to other cores.
+struct BlockMap {
+    long block_rows, block_cols, ncols;
+    long block_of(long i, long j) const { return (i - 1) / block_rows * ncols + (j - 1) / block_cols; }
+};
+
+/**
+ * Live-cell counts of a [1, height] x [1, width] board over blocks of
+ * block_rows x block_cols cells, sized so the grid fits in max_rows x
+ * max_cols. A board that fits is sampled one cell per block. Frames and
+ * PGM images are built from the counts in one buffer and written with one
+ * call.
+ */
+class DensityGrid {
+    long height, width;
+    long block_rows, block_cols;
+    long nrows, ncols;
+    std::vector<uint32_t> live;
+
+public:
+    DensityGrid(long height_, long width_, long max_rows, long max_cols) :
+        height(height_), width(width_),
+        block_rows((height_ + max_rows - 1) / std::max(max_rows, 1L)),
+        block_cols((width_ + max_cols - 1) / std::max(max_cols, 1L))
+    {
+        block_rows = std::max(block_rows, 1L);
+        block_cols = std::max(block_cols, 1L);
+        nrows = (height + block_rows - 1) / block_rows;
+        ncols = (width + block_cols - 1) / block_cols;
+        live.assign(nrows * ncols, 0);
+    }
+
+    long rows() const { return nrows; }
+    long cols() const { return ncols; }
+
+    BlockMap blocks() const { return BlockMap{ block_rows, block_cols, ncols }; }
+    long block_of(long i, long j) const { return blocks().block_of(i, j); }
+
+    void clear() { std::fill(live.begin(), live.end(), 0); }
+    void add(long i, long j, uint32_t n = 1) { live[block_of(i, j)] += n; }
+    void set_block(long b, uint32_t n) { live[b] = n; }
+
+    // Share of live cells in block (r, c); edge blocks count only their cells on the board.
+    double density(long r, long c) const {
+        long h = std::min(block_rows, height - r * block_rows);
+        long w = std::min(block_cols, width - c * block_cols);
+        return (double) live[r * ncols + c] / (h * w);
+    }
+
+    // The board framed like pretty_print always drew it; blocks shade by density.
+    std::string frame() const {
+        static const char shades[] = " .:-=+*%@#";
+        const bool one_to_one = block_rows == 1 && block_cols == 1;
+        std::string out;
+        out.reserve((nrows + 2) * (ncols + 3) + 16);
+        out += "\x1b[2J\x1b[;H";
+        out.append(ncols + 2, '-');
+        out += '\n';
+        for (long r = 0; r < nrows; r++) {
+            out += '|';
+            for (long c = 0; c < ncols; c++) {
+                double d = density(r, c);
+                out += one_to_one ? (d > 0 ? '#' : ' ')
+                                  : (d > 0 ? shades[std::max(1, std::min(9, (int)(d * 9 + 0.5)))] : ' ');
+            }
+            out += "|\n";
+        }
+        out.append(ncols + 2, '-');
+        out += '\n';
+        return out;
+    }
+
+    void print() const {
+        std::string f = frame();
+        fwrite(f.data(), 1, f.size(), stdout);
+        fflush(stdout);
+    }
+
+    // Binary greymap, one pixel per block, live density as brightness.
+    void write_pgm(const std::string& path) const {
+        std::string img = "P5\n" + std::to_string(ncols) + " " + std::to_string(nrows) + "\n255\n";
+        size_t header = img.size();
+        img.resize(header + nrows * ncols);
+        for (long r = 0; r < nrows; r++)
+            for (long c = 0; c < ncols; c++)
+                img[header + r * ncols + c] = (char)(uint8_t)(density(r, c) * 255 + 0.5);
+
+        FILE* f = fopen(path.c_str(), "wb");
+        if (!f) throw std::runtime_error("cannot write " + path);
+        bool ok = fwrite(img.data(), 1, img.size(), f) == img.size();
+        ok = fclose(f) == 0 && ok;
+        if (!ok) throw std::runtime_error("cannot write " + path);
+    }
+};
+
+// "<prefix>-<generation, zero padded>.pgm"
+inline std::string pgm_name(const std::string& prefix, uint64_t generation) {
+    char digits[32];
+    snprintf(digits, sizeof(digits), "%08llu", (unsigned long long) generation);
+    return prefix + "-" + digits + ".pgm";
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include <cctype>
+#include <cstdint>
+#include <stdexcept>
+#include <string>
+
+
+/**
+ * An outer-totalistic rule in B/S notation: bit n of `birth` (`survive`)
+ * set means a dead (live) cell with n live neighbours is alive next
+ * generation. The rule is compiled into two 16-entry tables indexed by the
+ * neighbour count, so a kernel looks its result up instead of branching,
+ * and a vector kernel can use a table as a byte shuffle.
+ */
+struct Rule {
+    uint16_t birth, survive;
+    alignas(16) uint8_t next[2][16];    // next[alive][neighbours], 0 or 1
+
+    Rule(uint16_t birth_ = 1 << 3, uint16_t survive_ = (1 << 2) | (1 << 3)) :
+        birth(birth_), survive(survive_)
+    {
+        for (int n = 0; n < 16; n++) {
+            next[0][n] = n <= 8 && ((birth >> n) & 1);
+            next[1][n] = n <= 8 && ((survive >> n) & 1);
+        }
+    }
+
+    bool operator==(const Rule& o) const { return birth == o.birth && survive == o.survive; }
+    bool operator!=(const Rule& o) const { return !(*this == o); }
+
+    /**
+     * "B3/S23" (either order, any case), or the older "23/3" form with the
+     * survival counts first.
+     */
+    static Rule parse(const std::string& text) {
+        uint16_t sets[2] = { 0, 0 };
+        int part = 0;
+        bool prefixed[2] = { false, false };
+        int which[2] = { 1, 0 };    // without letters: survival, then birth
+        for (char ch : text) {
+            char c = std::toupper((unsigned char) ch);
+            if (c == 'B' || c == 'S') {
+                which[part] = c == 'B' ? 0 : 1;
+                prefixed[part] = true;
+            } else if (c == '/') {
+                if (++part > 1) throw std::runtime_error("bad rule " + text);
+            } else if (c >= '0' && c <= '8') {
+                sets[part] |= 1 << (c - '0');
+            } else if (c != ' ') {
+                throw std::runtime_error("bad rule " + text);
+            }
+        }
+        if (part != 1 || prefixed[0] != prefixed[1] || which[0] == which[1])
+            throw std::runtime_error("bad rule " + text);
+
+        uint16_t birth = which[0] == 0 ? sets[0] : sets[1];
+        uint16_t survive = which[0] == 1 ? sets[0] : sets[1];
+        return Rule(birth, survive);
+    }
+
+    std::string name() const {
+        std::string s = "B";
+        for (int n = 0; n <= 8; n++) if ((birth >> n) & 1) s += char('0' + n);
+        s += "/S";
+        for (int n = 0; n <= 8; n++) if ((survive >> n) & 1) s += char('0' + n);
+        return s;
+    }
+};
+
+// A rule fixed at compile time, for kernels the compiler specializes.
+template <uint16_t Birth, uint16_t Survive>
+struct FixedRule {
+    static const uint16_t birth = Birth, survive = Survive;
+    static Rule rule() { return Rule(Birth, Survive); }
+    static uint8_t next(int is_alive, int neighbours) {
+        return ((is_alive ? Survive : Birth) >> neighbours) & 1;
+    }
+};
+
+typedef FixedRule<1 << 3, (1 << 2) | (1 << 3)> Conway;                   // B3/S23
+typedef FixedRule<(1 << 3) | (1 << 6), (1 << 2) | (1 << 3)> HighLife;    // B36/S23
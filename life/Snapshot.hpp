@@ -0,0 +1,304 @@
+#pragma once
+
+#include <Grappa.hpp>
+#include <fcntl.h>
+#include <unistd.h>
+#include <algorithm>
+#include <cerrno>
+#include <cstdint>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+#include "DistributedGrid.hpp"
+#include "Patterns.hpp"
+#include "Rule.hpp"
+
+
+using namespace Grappa;
+
+/**
+ * Snapshot file layout (host byte order): a fixed header, then one
+ * SnapshotEntry per block of the writer's layout in block id order, then
+ * the blocks' data at the offsets the entries give. A block's data covers
+ * its rows x cols cells row-major, without halo:
+ *  - Full:   one byte per cell, 0 dead and 1 alive;
+ *  - Sparse: the lengths of alternating dead and live runs, starting with
+ *            dead (possibly 0), each a LEB128 varint.
+ */
+enum class SnapshotFormat : uint32_t { Full = 0, Sparse = 1 };
+
+struct SnapshotHeader {
+    char     magic[8]   = { 'L', 'I', 'F', 'E', 'S', 'N', 'A', 'P' };
+    uint32_t version    = 1;
+    uint32_t format     = 0;
+    int64_t  height     = 0, width = 0;
+    int64_t  block_rows = 0, block_cols = 0;
+    int64_t  blocks     = 0;
+    int64_t  generation = 0;
+    uint16_t birth      = 0, survive = 0;
+    uint32_t reserved   = 0;
+};
+
+struct SnapshotEntry {
+    uint64_t offset, length;
+};
+
+inline void pwrite_fully(int fd, const void* buf, size_t nbytes, off_t offset) {
+    const char* p = (const char*) buf;
+    while (nbytes > 0) {
+        ssize_t n = pwrite(fd, p, nbytes, offset);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            throw std::runtime_error(std::string("pwrite failed: ") + strerror(errno));
+        }
+        p += n; offset += n; nbytes -= n;
+    }
+}
+
+// "<prefix>-<generation, zero padded>.snap"
+inline std::string snapshot_name(const std::string& prefix, uint64_t generation) {
+    char digits[32];
+    snprintf(digits, sizeof(digits), "%08llu", (unsigned long long) generation);
+    return prefix + "-" + digits + ".snap";
+}
+
+inline SnapshotFormat parse_snapshot_format(const std::string& name) {
+    if (name == "full") return SnapshotFormat::Full;
+    if (name == "sparse") return SnapshotFormat::Sparse;
+    throw std::runtime_error("unknown snapshot format " + name + " (full or sparse)");
+}
+
+// The layout a snapshot was written with; owners do not matter to the file.
+inline BlockLayout snapshot_layout(const SnapshotHeader& h) {
+    BlockLayout l;
+    l.height = h.height;
+    l.width = h.width;
+    l.block_rows = h.block_rows;
+    l.block_cols = h.block_cols;
+    l.nbr = BlockLayout::count(h.height, h.block_rows, 1);
+    l.nbc = BlockLayout::count(h.width, h.block_cols, 1);
+    return l;
+}
+
+/**
+ * One block's interior in either format. `alive` reads cell (r, c),
+ * 1-based within the block.
+ */
+template <typename F>
+std::vector<uint8_t> encode_block(long rows, long cols, SnapshotFormat format, F alive) {
+    std::vector<uint8_t> out;
+    if (format == SnapshotFormat::Full) {
+        out.resize(rows * cols);
+        for (long r = 1; r <= rows; r++)
+            for (long c = 1; c <= cols; c++)
+                out[(r - 1) * cols + c - 1] = alive(r, c) ? 1 : 0;
+        return out;
+    }
+
+    auto varint = [&out](uint64_t v) {
+        while (v >= 0x80) { out.push_back((uint8_t)(v | 0x80)); v >>= 7; }
+        out.push_back((uint8_t) v);
+    };
+    bool state = false;     // runs start dead
+    uint64_t run = 0;
+    for (long r = 1; r <= rows; r++) {
+        for (long c = 1; c <= cols; c++) {
+            if (alive(r, c) != state) { varint(run); run = 0; state = !state; }
+            run++;
+        }
+    }
+    varint(run);
+    return out;
+}
+
+/**
+ * Calls set(r, c) for every live cell of an encoded block (r, c 1-based
+ * within it); throws if the data does not cover exactly rows x cols cells.
+ */
+template <typename F>
+void decode_block(const uint8_t* data, uint64_t length, long rows, long cols, SnapshotFormat format, F set) {
+    const long cells = rows * cols;
+    if (format == SnapshotFormat::Full) {
+        if ((long) length != cells) throw std::runtime_error("snapshot block has the wrong size");
+        for (long k = 0; k < cells; k++)
+            if (data[k]) set(1 + k / cols, 1 + k % cols);
+        return;
+    }
+
+    const uint8_t* p = data;
+    const uint8_t* end = data + length;
+    long k = 0;
+    bool state = false;
+    while (p < end) {
+        uint64_t run = 0;
+        for (int shift = 0; ; shift += 7) {
+            if (p == end || shift > 63) throw std::runtime_error("corrupt snapshot block");
+            uint8_t byte = *p++;
+            run |= (uint64_t)(byte & 0x7f) << shift;
+            if (!(byte & 0x80)) break;
+        }
+        if (run > (uint64_t)(cells - k)) throw std::runtime_error("corrupt snapshot block");
+        if (state)
+            for (long e = k + run; k < e; k++) set(1 + k / cols, 1 + k % cols);
+        else
+            k += run;
+        state = !state;
+    }
+    if (k != cells) throw std::runtime_error("corrupt snapshot block");
+}
+
+inline SnapshotHeader read_snapshot_header(const std::string& path) {
+    MappedFile file(path);
+    SnapshotHeader h;
+    if ((size_t)(file.end() - file.begin()) < sizeof(h))
+        throw std::runtime_error(path + ": not a snapshot");
+    memcpy(&h, file.begin(), sizeof(h));
+    if (memcmp(h.magic, SnapshotHeader().magic, sizeof(h.magic)) != 0 || h.version != 1)
+        throw std::runtime_error(path + ": not a snapshot");
+    if (h.format > (uint32_t) SnapshotFormat::Sparse || h.height < 1 || h.width < 1 ||
+        h.block_rows < 1 || h.block_cols < 1 || h.blocks != snapshot_layout(h).blocks())
+        throw std::runtime_error(path + ": bad snapshot header");
+    if ((size_t)(file.end() - file.begin()) < sizeof(h) + h.blocks * sizeof(SnapshotEntry))
+        throw std::runtime_error(path + ": truncated snapshot");
+    return h;
+}
+
+/**
+ * Collective checkpoint of a grid of one-byte cells (non-zero is alive).
+ * Every core encodes its own blocks and writes them at their offsets with
+ * one pwrite each; the master writes the header and the block table. Full
+ * blocks have sizes known from the layout; sparse ones are sized first,
+ * and every core learns all sizes, hence every offset, from one exchange.
+ */
+template <typename Grid>
+void write_snapshot(const Grid& grid, const std::string& path, SnapshotFormat format,
+                    int64_t generation, const Rule& rule) {
+    typedef typename Grid::Block Block;
+    static_assert(sizeof(typename Grid::Cell) == 1, "snapshots hold one-byte cells");
+    // the header records block sides only: no merged last block (see BlockLayout)
+    static_assert(Grid::halo == 1, "snapshots hold grids with one-cell halos");
+
+    // lambdas are shipped to the other cores by value: capture a plain array
+    char fname[256];
+    if (path.size() >= sizeof(fname))
+        throw std::runtime_error("snapshot path too long: " + path);
+    strcpy(fname, path.c_str());
+
+    int fd = open(path.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0)
+        throw std::runtime_error("cannot create " + path + ": " + strerror(errno));
+    close(fd);
+
+    on_all_cores([=]{
+        const BlockLayout& l = grid.layout;
+        auto& me = grid.mine();
+        std::vector<std::vector<uint8_t>> encoded;
+        for (Block& b : me.blocks)
+            encoded.push_back(encode_block(b.rows, b.cols, format, [&b](long r, long c) {
+                return (uint8_t) b.row(r)[c] != 0;
+            }));
+
+        std::vector<double> sizes(l.blocks());
+        if (format == SnapshotFormat::Full) {
+            for (long b = 0; b < l.blocks(); b++) sizes[b] = l.rows_of(b) * l.cols_of(b);
+        } else {
+            // sizes are far below 2^53, so the weights carry them exactly
+            sizes = grid.gather_weights([&me, &encoded](Block& b) {
+                return (double) encoded[me.index_of[b.id]].size();
+            });
+        }
+
+        std::vector<SnapshotEntry> table(l.blocks());
+        uint64_t offset = sizeof(SnapshotHeader) + l.blocks() * sizeof(SnapshotEntry);
+        for (long b = 0; b < l.blocks(); b++) {
+            table[b].offset = offset;
+            table[b].length = (uint64_t) sizes[b];
+            offset += table[b].length;
+        }
+
+        int fd = open(fname, O_WRONLY);
+        if (fd < 0)
+            throw std::runtime_error(std::string("cannot open ") + fname + ": " + strerror(errno));
+        if (mycore() == 0) {
+            SnapshotHeader h;
+            h.format = (uint32_t) format;
+            h.height = l.height;
+            h.width = l.width;
+            h.block_rows = l.block_rows;
+            h.block_cols = l.block_cols;
+            h.blocks = l.blocks();
+            h.generation = generation;
+            h.birth = rule.birth;
+            h.survive = rule.survive;
+            pwrite_fully(fd, &h, sizeof(h), 0);
+            pwrite_fully(fd, table.data(), table.size() * sizeof(SnapshotEntry), sizeof(h));
+        }
+        for (size_t k = 0; k < me.blocks.size(); k++)
+            pwrite_fully(fd, encoded[k].data(), encoded[k].size(), table[me.blocks[k].id].offset);
+        close(fd);
+    });
+}
+
+/**
+ * Collective restore into a grid of the snapshot's height and width,
+ * whatever block layout and core count wrote it. Every core maps the file
+ * and decodes only the snapshot blocks overlapping its own, so no cell
+ * crosses the network. Blocks are cleared, halos included, before the live
+ * cells are set, and every block is marked active.
+ */
+template <typename Grid>
+void load_snapshot(const Grid& grid, const std::string& path) {
+    typedef typename Grid::Block Block;
+    typedef typename Grid::Cell Cell;
+    static_assert(sizeof(Cell) == 1, "snapshots hold one-byte cells");
+
+    char fname[256];
+    if (path.size() >= sizeof(fname))
+        throw std::runtime_error("snapshot path too long: " + path);
+    strcpy(fname, path.c_str());
+
+    SnapshotHeader h = read_snapshot_header(path);
+    if (h.height != grid.height() || h.width != grid.width())
+        throw std::runtime_error(path + ": snapshot is " + std::to_string(h.height) + "x" +
+                                 std::to_string(h.width) + ", the board " + std::to_string(grid.height()) +
+                                 "x" + std::to_string(grid.width()));
+
+    on_all_cores([=]{
+        MappedFile file(fname);
+        const uint8_t* base = (const uint8_t*) file.begin();
+        const uint64_t size = file.end() - file.begin();
+        const SnapshotEntry* table = (const SnapshotEntry*)(base + sizeof(SnapshotHeader));
+        const BlockLayout from = snapshot_layout(h);
+        auto& me = grid.mine();
+
+        for (Block& b : me.blocks) {
+            std::fill(b.cells.begin(), b.cells.end(), static_cast<Cell>(0));
+            b.activity = std::max(b.activity, 1L);
+        }
+
+        for (long s = 0; s < from.blocks(); s++) {
+            const long i0 = from.first_row(s), j0 = from.first_col(s);
+            const long rows = from.rows_of(s), cols = from.cols_of(s);
+            // my blocks overlapping snapshot block s
+            std::vector<Block*> targets;
+            for (Block& b : me.blocks)
+                if (b.i0 < i0 + rows && i0 < b.i0 + b.rows && b.j0 < j0 + cols && j0 < b.j0 + b.cols)
+                    targets.push_back(&b);
+            if (targets.empty()) continue;
+
+            if (table[s].offset > size || table[s].length > size - table[s].offset)
+                throw std::runtime_error(std::string(fname) + ": truncated snapshot");
+            decode_block(base + table[s].offset, table[s].length, rows, cols, (SnapshotFormat) h.format,
+                         [&](long r, long c) {
+                long i = i0 + r - 1, j = j0 + c - 1;
+                for (Block* b : targets)
+                    if (b->contains(i, j)) {
+                        b->at(i, j) = static_cast<Cell>(1);
+                        break;
+                    }
+            });
+        }
+    });
+}
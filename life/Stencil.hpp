@@ -0,0 +1,408 @@
+#pragma once
+
+#include <Grappa.hpp>
+#include <algorithm>
+#include <utility>
+#include <vector>
+
+#include "BandPool.hpp"
+#include "DistributedGrid.hpp"
+
+
+using namespace Grappa;
+
+namespace Spaces {
+
+    struct Range {
+        long lower = 0, upper = 0;
+        size_t width() const { return upper-lower; }
+        Range() {}
+        Range(long upper_) : upper(upper_) {}
+        Range(long lower_, long upper_) : lower(lower_), upper(upper_) {}
+        Range(const Spaces::Range& r): lower(r.lower), upper(r.upper) {}
+        long indexof(long i) const { return i - lower; }
+
+    };
+
+
+    struct Domain {
+        Range x, y;
+        Domain(){}
+        Domain(const Domain& d) : x(d.x), y(d.y) {}
+        Domain(Range x_, Range y_)  : x(x_), y(y_) {}
+        size_t size() const { return x.width() * y.width(); }
+
+        long project(long i, long j) const {
+            long pos = x.indexof(i) + x.width() * y.indexof(j);
+            return pos;
+        }
+
+        std::pair<long,long> unproject(long proj) const {
+            long i,j;
+
+            i = proj % x.width() + x.lower;
+            j = proj / x.width() + y.lower;
+
+            return std::make_pair(i,j);
+        }
+    };
+
+    /**
+     * The cells of a domain in one array, x fastest (see Domain::project):
+     * a line of fixed y is contiguous.
+     */
+    template <typename Cell>
+    struct Board {
+        Domain domain;
+        Cell* values;
+
+        // clear = false leaves the cells untouched, for callers that want
+        // each thread to touch (and so place) its own part first
+        Board(Domain domain_, bool clear = true) : domain(domain_) , values(new Cell[domain_.size()]) {
+            if (clear) clear_lines(domain.y.lower, domain.y.upper);
+        }
+        ~Board() { delete [] values; }
+
+        // a Board owns its cells: hand them over with swap() instead of copying
+        Board(const Board&) = delete;
+        Board& operator=(const Board&) = delete;
+
+        void swap(Board& other) {
+            std::swap(domain, other.domain);
+            std::swap(values, other.values);
+        }
+
+        long project(long i, long j) const { return domain.project(i, j); }
+
+        Cell& get(long i, long j) { return values[ project(i,j) ]; }
+
+        Cell& operator()(long i, long j) { return get(i,j); }
+
+        // sets every cell with j in [j_begin, j_end) to `value`
+        void clear_lines(long j_begin, long j_end, Cell value = Cell()) {
+            std::fill(&values[project(domain.x.lower, j_begin)],
+                      &values[project(domain.x.lower, j_end)], value);
+        }
+    };
+
+}
+
+/**
+ * Stencil updates. A 2D stencil of radius R computes a cell's next value
+ * from the cells within R of it, rows and columns alike. The engines below
+ * call an update once per row segment:
+ *
+ *     struct Update {
+ *         typedef ... Cell;
+ *         static const int radius = R;
+ *         void operator()(const Cell* const* lines, Cell* out, long begin, long end) const;
+ *     };
+ *
+ * lines[k], k = 0 .. 2R, is row r - R + k; the update writes columns
+ * [begin, end) of row r to `out`, reading lines[k][begin - R .. end + R).
+ * Columns index the lines directly, so a whole row is one pointer and the
+ * inner loop is the update's own. Updates are copied to every core and
+ * thread, so they hold plain data only.
+ */
+
+// The (2R+1) x (2R+1) cells around column j of the middle line.
+template <typename Cell, int R>
+struct Neighbourhood {
+    const Cell* const* lines;
+    long j;
+
+    // the cell di rows down and dj columns right, |di|, |dj| <= R
+    const Cell& operator()(int di, int dj) const { return lines[R + di][j + dj]; }
+};
+
+// A per-cell rule f(Neighbourhood) -> Cell as an update; f is plain data too.
+template <typename Cell_, int R, typename F>
+struct PointUpdate {
+    typedef Cell_ Cell;
+    static const int radius = R;
+    F f;
+
+    void operator()(const Cell* const* lines, Cell* out, long begin, long end) const {
+        for (long j = begin; j < end; j++) out[j] = f(Neighbourhood<Cell, R>{ lines, j });
+    }
+};
+
+/**
+ * A stencil on one process: a height x width interior, rows [1, height] and
+ * columns [1, width], inside a border R cells deep that holds `boundary`
+ * for good. Two boards swap roles every generation. Threads step bands of
+ * rows, band b always the same rows on the same thread (see BandPool), and
+ * a band walks its rows one column tile at a time, so the 2R + 1 lines a
+ * row reads stay in cache until the next row reuses 2R of them.
+ */
+template <typename U>
+class TiledStencil {
+public:
+    typedef typename U::Cell Cell;
+    static const int R = U::radius;
+    static_assert(R >= 1, "a stencil reads its neighbours");
+
+private:
+    static const long tile_bytes = 256 << 10;    // the lines of one column tile
+
+    long rows, cols;
+    U update;
+    Spaces::Domain domain;          // x: columns, y: rows, border included
+    Spaces::Board<Cell> board;
+    Spaces::Board<Cell> next;       // the generation being computed
+    BandPool bands;
+    long tile_cols;
+
+    // row i of a board, indexed by column
+    Cell* line(Spaces::Board<Cell>& b, long i) { return &b.get(0, i); }
+
+    void step_once() {
+        bands.run([this](int band) {
+            std::pair<long,long> mine = bands.band(1, rows + 1, band);
+            const Cell* lines[2 * R + 1];
+            for (long j0 = 1; j0 <= cols; j0 += tile_cols) {
+                const long j1 = std::min(j0 + tile_cols, cols + 1);
+                for (long i = mine.first; i < mine.second; i++) {
+                    for (int k = 0; k <= 2 * R; k++) lines[k] = line(board, i - R + k);
+                    update(lines, line(next, i), j0, j1);
+                }
+            }
+        });
+        board.swap(next);
+    }
+
+public:
+    TiledStencil(long height, long width, const U& update_, int threads = 1, Cell boundary = Cell()) :
+        rows(height), cols(width), update(update_),
+        domain(Spaces::Range(1 - R, width + 1 + R), Spaces::Range(1 - R, height + 1 + R)),
+        board(domain, false),
+        next(domain, false),
+        bands(threads),
+        tile_cols(std::max(64L, (long)(tile_bytes / (sizeof(Cell) * (2 * R + 2)))))
+    {
+        // first touch by the owning thread; the first and last band also take the border rows
+        bands.run([this, boundary](int band) {
+            std::pair<long,long> mine = bands.band(1, rows + 1, band);
+            if (band == 0) mine.first = 1 - R;
+            if (band == bands.size() - 1) mine.second = rows + 1 + R;
+            board.clear_lines(mine.first, mine.second, boundary);
+            next.clear_lines(mine.first, mine.second, boundary);
+        });
+    }
+
+    long height() const { return rows; }
+    long width() const { return cols; }
+
+    Cell get(long i, long j) { return board.get(j, i); }
+
+    // Cells off the interior belong to the border and are left alone.
+    void set(long i, long j, Cell value) {
+        if (i >= 1 && i <= rows && j >= 1 && j <= cols) board.get(j, i) = value;
+    }
+
+    // Sets every interior cell to f(i, j), each band its own rows.
+    template <typename F>
+    void fill(F f) {
+        bands.run([this, &f](int band) {
+            std::pair<long,long> mine = bands.band(1, rows + 1, band);
+            for (long i = mine.first; i < mine.second; i++) {
+                Cell* row = line(board, i);
+                for (long j = 1; j <= cols; j++) row[j] = f(i, j);
+            }
+        });
+    }
+
+    // Calls f(i, j, cell) for every interior cell, in row order.
+    template <typename F>
+    void for_each(F f) {
+        for (long i = 1; i <= rows; i++) {
+            Cell* row = line(board, i);
+            for (long j = 1; j <= cols; j++) f(i, j, row[j]);
+        }
+    }
+
+    void step(long generations = 1) {
+        for (long g = 0; g < generations; g++) step_once();
+    }
+};
+
+/**
+ * The same stencil over a DistributedGrid whose halos are R cells deep, so
+ * one exchange per generation brings every cell a row reads. Two grids
+ * swap roles every generation; the handles are swapped by the caller's
+ * task, every core holding both. A core steps the interior of its blocks
+ * (the cells at least R from every edge) while its halos are in flight,
+ * and the ring along the edges once they have come. Halos past the board
+ * edge keep `boundary`.
+ *
+ * A block whose activity is 0, no cell of it having changed, cannot change
+ * its interior next generation, and if its neighbours did not change either
+ * it cannot change at all; `next` already holds it, being the generation
+ * before, so such a block is skipped and a quiet block next to an active
+ * one steps just its ring. What counts as a change is the Observer's to
+ * say; the default one never says a block is quiet, so nothing is skipped.
+ * Info is kept per block, for the observer.
+ */
+template <typename U, typename Info = NoBlockInfo>
+class DistributedStencil {
+public:
+    typedef typename U::Cell Cell;
+    static const int R = U::radius;
+    typedef DistributedGrid<Cell, Info, R> Grid;
+    typedef typename Grid::Block Block;
+
+    /**
+     * What step() reports, block by block on each block's owner; `b` is the
+     * block now, `out` the same block in the generation being computed. An
+     * observer hides the members it cares about and is copied to every
+     * core, so it holds plain data only.
+     */
+    struct Observer {
+        // `out` is about to be computed; not called for a skipped block
+        void begin(Block& b, Block& out) const {}
+        // columns [c0, c1) of row r of `out` were computed from `b`
+        void row(Block& b, Block& out, long r, long c0, long c1) const {}
+        // rows [r0, r1], columns [c0, c1) of `out` were not stepped, being the same as `b`'s
+        void kept(Block& b, Block& out, long r0, long r1, long c0, long c1) const {}
+        // none of `out` was stepped; its activity is set to 0
+        void skipped(Block& b, Block& out) const {}
+        // `out` is done: its activity, 0 if no cell of it changed
+        long end(Block& b, Block& out) const { return 1; }
+        // every core, after its blocks: collectives are fine here
+        void finish(const Grid& to) const {}
+    };
+
+private:
+    Grid current, next;
+    U update;
+
+    // Columns [c0, c1) of rows [r0, r1] of a block, into the same cells of `out`.
+    template <typename O>
+    static void step_rows(const U& update, const O& obs, Block& b, Block& out, long r0, long r1, long c0, long c1) {
+        if (c0 >= c1) return;
+        const Cell* lines[2 * R + 1];
+        for (long r = r0; r <= r1; r++) {
+            for (int k = 0; k <= 2 * R; k++) lines[k] = b.row(r - R + k);
+            update(lines, out.row(r), c0, c1);
+            obs.row(b, out, r, c0, c1);
+        }
+    }
+
+    template <typename O>
+    static void step_interior(const U& update, const O& obs, Block& b, Block& out) {
+        step_rows(update, obs, b, out, 1 + R, b.rows - R, 1 + R, b.cols - R + 1);
+    }
+
+    // Everything step_interior() leaves out, each cell once however small the block.
+    template <typename O>
+    static void step_ring(const U& update, const O& obs, Block& b, Block& out) {
+        const long top = std::min<long>(R, b.rows), bottom = std::max<long>(b.rows - R + 1, top + 1);
+        const long left = std::min<long>(1 + R, b.cols + 1), right = std::max<long>(b.cols - R + 1, left);
+        step_rows(update, obs, b, out, 1, top, 1, b.cols + 1);
+        step_rows(update, obs, b, out, bottom, b.rows, 1, b.cols + 1);
+        step_rows(update, obs, b, out, top + 1, bottom - 1, 1, left);
+        step_rows(update, obs, b, out, top + 1, bottom - 1, right, b.cols + 1);
+    }
+
+public:
+    // Collective; blocks must be at least R cells on a side (0: one block per core).
+    DistributedStencil(long height, long width, const U& update_, long block_side = 0, Cell boundary = Cell()) :
+        current(height, width, block_side, boundary),
+        next(height, width, block_side, boundary),
+        update(update_) {}
+
+    // Collective: frees both grids.
+    void destroy() {
+        current.destroy();
+        next.destroy();
+    }
+
+    long height() const { return current.height(); }
+    long width() const { return current.width(); }
+    const Grid& grid() const { return current; }
+
+    Cell get(long i, long j) const { return current.get(i, j); }
+    void set(long i, long j, Cell value) const { current.set(i, j, value); }
+
+    // Collective: sets every interior cell to f(i, j) on its owner, marking every block changed.
+    template <typename F>
+    void fill(F f) const {
+        current.forall_cells([f](long i, long j, Cell& c, Block& b) {
+            c = f(i, j);
+            b.activity = std::max(b.activity, 1L);
+        });
+    }
+
+    // Collective: calls f(i, j, cell) for every cell on its owner.
+    template <typename F>
+    void forall_cells(F f) const {
+        current.forall_cells([f](long i, long j, Cell& c, Block&) { f(i, j, c); });
+    }
+
+    /**
+     * Collective: combines f(i, j, cell) over every cell with Op, starting
+     * from `init` on every core, and returns the result to the caller.
+     */
+    template <typename T, T (*Op)(const T&, const T&), typename F>
+    T reduce(T init, F f) const {
+        T result = init;
+        T* out = &result;           // only core 0, the caller's, writes it
+        const Grid g = current;
+        on_all_cores([g, init, f, out]{
+            T mine = init;
+            for (Block& b : g.mine().blocks)
+                for (long r = 1; r <= b.rows; r++)
+                    for (long c = 1; c <= b.cols; c++)
+                        mine = Op(mine, f(b.i0 + r - 1, b.j0 + c - 1, b.row(r)[c]));
+            T total = allreduce<T, Op>(mine);
+            if (mycore() == 0) *out = total;
+        });
+        return result;
+    }
+
+    /**
+     * Inside on_all_cores, every core passing the same table: moves both
+     * grids' blocks to `owners` (see DistributedGrid::migrate). Returns the
+     * blocks this core sent of one grid.
+     */
+    long migrate(const std::vector<Core>& owners) const {
+        long moved = current.migrate(owners);
+        next.migrate(owners);
+        return moved;
+    }
+
+    template <typename O = Observer>
+    void step(long generations = 1, const O& observer = O()) {
+        for (long n = 0; n < generations; n++) {
+            const Grid from = current, to = next;
+            const U u = update;
+            const O obs = observer;
+            on_all_cores([from, to, u, obs]{
+                from.begin_exchange();
+                for (Block& b : from.mine().blocks) {
+                    if (!b.activity) continue;
+                    Block& out = to.mine().block(b.id);
+                    obs.begin(b, out);
+                    step_interior(u, obs, b, out);
+                }
+                from.wait_halos();
+                for (Block& b : from.mine().blocks) {
+                    Block& out = to.mine().block(b.id);
+                    if (!b.activity && !b.neighbour_activity) {
+                        obs.skipped(b, out);
+                        out.activity = 0;
+                        continue;
+                    }
+                    if (!b.activity) {
+                        obs.begin(b, out);
+                        obs.kept(b, out, 1 + R, b.rows - R, 1 + R, b.cols - R + 1);
+                    }
+                    step_ring(u, obs, b, out);
+                    out.activity = obs.end(b, out);
+                }
+                obs.finish(to);
+            });
+            std::swap(current, next);
+        }
+    }
+};
@@ -0,0 +1,135 @@
+#include <Grappa.hpp>
+#include <cmath>
+#include <iomanip>
+#include <limits>
+#include <stdexcept>
+#include <string>
+
+#include "Stencil.hpp"
+
+DEFINE_int64(height, 512, "grid height in cells");
+DEFINE_int64(width, 512, "grid width in cells");
+DEFINE_int64(generations, 100, "time steps to run");
+DEFINE_int64(order, 2, "spatial order: 2 (5-point Laplacian, radius 1) or 4 (9-point cross, radius 2)");
+DEFINE_double(alpha, 0.15, "diffusion number D dt / dx^2; at most 1/4 for order 2 and 3/16 for order 4");
+DEFINE_double(hot, 100, "temperature of the disc the grid starts with");
+DEFINE_double(disc, 0.25, "radius of that disc, as a share of the shorter side");
+DEFINE_double(boundary, 0, "fixed temperature around the grid");
+DEFINE_string(engine, "threads", "'threads' (one process, banded and tiled) or 'distributed' (blocks over all cores)");
+DEFINE_int64(threads, 1, "threads engine: threads stepping the grid");
+DEFINE_int64(block, 0, "distributed engine: side of the square blocks (0: one block per core)");
+
+/**
+ * Explicit Euler steps of the heat equation u_t = D (u_xx + u_yy) on the
+ * stencil engines: both updates below are per-cell rules, one of radius 1
+ * and one of radius 2, and the engines take care of tiling, threads and
+ * halos.
+ */
+
+// Second order: the 5-point Laplacian.
+struct FivePoint {
+    double alpha;
+    double operator()(const Neighbourhood<double, 1>& u) const {
+        return u(0,0) + alpha * (u(-1,0) + u(1,0) + u(0,-1) + u(0,1) - 4 * u(0,0));
+    }
+};
+
+// Fourth order: (-u[-2] + 16 u[-1] - 30 u[0] + 16 u[1] - u[2]) / 12 along each axis.
+struct NinePointCross {
+    double alpha;
+    double operator()(const Neighbourhood<double, 2>& u) const {
+        double near = u(-1,0) + u(1,0) + u(0,-1) + u(0,1);
+        double far  = u(-2,0) + u(2,0) + u(0,-2) + u(0,2);
+        return u(0,0) + alpha * (16 * near - far - 60 * u(0,0)) / 12;
+    }
+};
+
+typedef PointUpdate<double, 1, FivePoint> Heat2;
+typedef PointUpdate<double, 2, NinePointCross> Heat4;
+
+// The starting temperatures: `hot` in a disc at the centre, `cold` elsewhere.
+struct HotDisc {
+    double ci, cj, r2, hot, cold;
+    double operator()(long i, long j) const {
+        double di = i - ci, dj = j - cj;
+        return di * di + dj * dj <= r2 ? hot : cold;
+    }
+};
+
+struct Totals {
+    double heat, max;
+};
+
+void report(const char* when, const Totals& t) {
+    std::cout << std::setprecision(12) << when << ": total heat " << t.heat << ", max temperature " << t.max << "\n";
+}
+
+template <typename U>
+void run(const U& update, const HotDisc& disc) {
+    const long height = FLAGS_height, width = FLAGS_width;
+    double stepping = 0;
+
+    if (FLAGS_engine == "threads") {
+        TiledStencil<U> grid(height, width, update, FLAGS_threads, FLAGS_boundary);
+        grid.fill(disc);
+        auto totals = [&grid] {
+            Totals t{ 0, -std::numeric_limits<double>::infinity() };
+            grid.for_each([&t](long, long, double u) { t.heat += u; t.max = std::max(t.max, u); });
+            return t;
+        };
+        report("start", totals());
+        double start = walltime();
+        grid.step(FLAGS_generations);
+        stepping = walltime() - start;
+        report("end", totals());
+    } else if (FLAGS_engine == "distributed") {
+        DistributedStencil<U> grid(height, width, update, FLAGS_block, FLAGS_boundary);
+        grid.fill(disc);
+        auto totals = [&grid] {
+            auto value = [](long, long, double u) { return u; };
+            return Totals{ grid.template reduce<double, collective_add<double>>(0, value),
+                           grid.template reduce<double, collective_max<double>>(
+                               -std::numeric_limits<double>::infinity(), value) };
+        };
+        report("start", totals());
+        double start = walltime();
+        grid.step(FLAGS_generations);
+        stepping = walltime() - start;
+        report("end", totals());
+        grid.destroy();
+    } else {
+        throw std::runtime_error("unknown engine " + FLAGS_engine + " (threads or distributed)");
+    }
+
+    double gens = FLAGS_generations;
+    std::cout << std::setprecision(6) << FLAGS_engine << " " << height << "x" << width << ", order " << FLAGS_order << ": "
+              << gens << " steps in " << stepping << " s, "
+              << gens * height * width / stepping << " cell updates/s\n";
+}
+
+void main_body() {
+    const double r = FLAGS_disc * std::min(FLAGS_height, FLAGS_width);
+    HotDisc disc{ (FLAGS_height + 1) / 2.0, (FLAGS_width + 1) / 2.0, r * r, FLAGS_hot, FLAGS_boundary };
+
+    if (FLAGS_order == 2) {
+        if (FLAGS_alpha <= 0 || FLAGS_alpha > 0.25)
+            throw std::runtime_error("order 2 is stable for 0 < alpha <= 1/4");
+        run(Heat2{ FivePoint{ FLAGS_alpha } }, disc);
+    } else if (FLAGS_order == 4) {
+        if (FLAGS_alpha <= 0 || FLAGS_alpha > 3.0 / 16)
+            throw std::runtime_error("order 4 is stable for 0 < alpha <= 3/16");
+        run(Heat4{ NinePointCross{ FLAGS_alpha } }, disc);
+    } else {
+        throw std::runtime_error("--order is 2 or 4");
+    }
+}
+
+int main(int argc, char* argv[])
+{
+    Grappa::init(&argc, &argv);
+    Grappa::run([]{
+        main_body();
+    });
+    Grappa::finalize();
+    return 0;
+}
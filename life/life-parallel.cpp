@@ -4,267 +4,343 @@
 #include <array>
 #include <chrono>
 #include <thread>
-
-enum class State { Dead, Alive };
-typedef GlobalAddress<State> GState;
-
-Grappa::GlobalCompletionEvent step_gce;
-
-namespace Spaces {
-
-    struct Range {
-        long lower = 0, upper = 0;
-        size_t width() const { return upper-lower; }
-        Range() {}
-        Range(long upper_) : upper(upper_) {}
-        Range(long lower_, long upper_) : lower(lower_), upper(upper_) {}
-        Range(const Spaces::Range& r): lower(r.lower), upper(r.upper) {}
-        long indexof(long i) const { return i - lower; }
-
-    };
-
-
-    struct Domain {
-        Range x, y;
-        Domain(){}
-        Domain(const Domain& d) : x(d.x), y(d.y) {}
-        Domain(Range x_, Range y_)  : x(x_), y(y_) {}
-        size_t size() { return x.width() * y.width(); }
-
-        long project(long i, long j) const {
-            long pos = x.indexof(i) + x.width() * y.indexof(j);
-            return pos;
-        }
-
-        std::pair<long,long> unproject(long proj) const {
-            long i,j;
-
-            i = proj % x.width() + x.lower;
-            j = proj / y.width() + y.lower;
-
-            return std::make_pair(i,j);
-        } 
-    };
-
-    struct Subdomain : public Domain {
-        Subdomain(){}
-        Subdomain(Domain domain_) :  Domain::Domain(domain_)  {}
-        void expand(long amount) {
-            x.lower -= amount; 
-            y.upper += amount;
-        }
-    };
-
-    struct Board {
-        Domain domain;
-        // State* values;
-        GState values;
-
-
-
-        struct Cell {
-            Board* parent;
-            long i,j;
-            Cell(Board* parent_, long i_, long j_) : 
-                parent(parent_),
-                i(i_),
-                j(j_) {}
-
-            Board& operator=(const State& s) {
-                Grappa::delegate::write(parent->get(i,j), s);
-                return *parent;
-            }
-        };
-
-        Board() {}
-
-        Board(Domain domain_) : 
-            domain(domain_) 
-            // values(new State[domain_.size()]) 
-        {
-            // for (int i = 0; i < domain_.size(); i++) values[i] = State::Dead;
-            values = Grappa::global_alloc<State>(domain_.size());
-            Grappa::forall(values, domain_.size(), [] (State& s) { s = State::Dead; });
+#include <cstring>
+#include <stdexcept>
+
+#include <vector>
+
+// one byte per cell, so the line kernels can step a block row as uint8_t
+enum class State : uint8_t { Dead, Alive };
+
+#include "DistributedGrid.hpp"
+#include "LineKernels.hpp"
+#include "Patterns.hpp"
+#include "Render.hpp"
+#include "Rule.hpp"
+#include "Snapshot.hpp"
+#include "Stencil.hpp"
+
+DEFINE_int64(height, 3, "board height in cells");
+DEFINE_int64(width, 3, "board width in cells");
+DEFINE_int64(block, 0, "side of the square blocks the board is split into (0: one block per core)");
+DEFINE_string(rule, "B3/S23", "birth/survival rule, e.g. B36/S23 for HighLife");
+DEFINE_string(pattern, "", "RLE, plaintext or Life 1.06 file to start from instead of the blinker");
+DEFINE_double(soup, 0, "fill the board at random with this share of live cells instead of the blinker (0: off)");
+DEFINE_int64(soup_seed, 1, "seed for --soup");
+DEFINE_int64(generations, 10, "generations to run");
+DEFINE_bool(headless, false, "no frames: time the run and report generations/s and cell updates/s");
+DEFINE_int64(delay_ms, 500, "pause between frames");
+DEFINE_int64(pgm_every, 0, "write a PGM frame every this many generations (0: never)");
+DEFINE_string(pgm_prefix, "life", "PGM frames are written to <prefix>-<generation>.pgm");
+DEFINE_int64(rebalance_every, 32, "generations between rebalancing block ownership by activity (0: never)");
+DEFINE_bool(stats, false, "print population, births, deaths and bounding box every generation");
+DEFINE_int64(pgm_max, 1024, "downsample PGM frames to at most this many pixels per side");
+DEFINE_int64(snapshot_every, 0, "write a snapshot every this many generations (0: never)");
+DEFINE_string(snapshot_prefix, "life", "snapshots are written to <prefix>-<generation>.snap");
+DEFINE_string(snapshot_format, "sparse", "snapshot blocks: 'full' (a byte per cell) or 'sparse' (run lengths)");
+DEFINE_string(resume, "", "snapshot to resume from; its size, rule and generation replace --height, --width and --rule");
+
+/**
+ * What one generation did: live cells, cells born and cells that died,
+ * and the rows and columns spanned by the live cells (imin > imax when
+ * there are none). Every core tallies its own cells while it steps them;
+ * one allreduce combines the tallies.
+ */
+struct GenerationStats {
+    long population = 0, births = 0, deaths = 0;
+    long imin = std::numeric_limits<long>::max(), imax = std::numeric_limits<long>::min();
+    long jmin = std::numeric_limits<long>::max(), jmax = std::numeric_limits<long>::min();
+
+    bool empty() const { return imin > imax; }
+
+    // Cells [begin, end) of row i, before and after a generation; cell k is column j0 + k - 1.
+    void tally(const State* before, const State* after, long begin, long end, long i, long j0) {
+        long alive = 0, born = 0, died = 0;
+        for (long k = begin; k < end; k++) {
+            long now = after[k] == State::Alive, was = before[k] == State::Alive;
+            alive += now;
+            born += now & (was ^ 1);
+            died += was & (now ^ 1);
         }
-        // Board(Domain domain_, State* values_) : domain(domain_), values(values_) {}
-
-
-
-        GState get(long i, long j) const {
-            return values + domain.project(i,j);
-        }
-
-        Cell operator()(long i, long j) {
-            return Cell(this, i, j);
-        }
-
-        template<typename F>
-        void forall_cells(F loop_body) {
-            const Domain d = domain;
-            Grappa::forall(values, domain.size(), [d, loop_body](int64_t pos, State& s) {
-                std::pair<long,long> coords = d.unproject((long)pos);
-                loop_body(coords, s);
-            });
-        }
-
-        Board& assign(Board& value) {
-            // quick&dirty: this should become a memcpy!                        
-            // for (int i = value.domain.x.lower; i < value.domain.x.upper; i++) {
-            //     for (int j = value.domain.y.lower; j < value.domain.y.upper; j++) {
-            //         get(i,j) = value.get(i,j);
-            //     }
-            // }
-            forall_cells([value](std::pair<long, long> coords, State& target){
-                target = Grappa::delegate::read(value.get(coords.first,coords.second));
-            });
-            return *this;
-        }
-
-        Board& operator&=(Board value) {
-            return assign(value);
-        }
-
+        population += alive;
+        births += born;
+        deaths += died;
+        if (!alive) return;
+        long first = begin, last = end - 1;
+        while (after[first] != State::Alive) first++;
+        while (after[last] != State::Alive) last--;
+        imin = std::min(imin, i);
+        imax = std::max(imax, i);
+        jmin = std::min(jmin, j0 + first - 1);
+        jmax = std::max(jmax, j0 + last - 1);
+    }
 
-    };
+    static GenerationStats combine(const GenerationStats& a, const GenerationStats& b) {
+        GenerationStats s;
+        s.population = a.population + b.population;
+        s.births = a.births + b.births;
+        s.deaths = a.deaths + b.deaths;
+        s.imin = std::min(a.imin, b.imin);
+        s.imax = std::max(a.imax, b.imax);
+        s.jmin = std::min(a.jmin, b.jmin);
+        s.jmax = std::max(a.jmax, b.jmax);
+        return s;
+    }
+};
 
+std::ostream& operator<<(std::ostream& o, const GenerationStats& s) {
+    o << "population " << s.population << ", births " << s.births << ", deaths " << s.deaths;
+    if (s.empty()) return o << ", no live cells";
+    return o << ", bounding box [" << s.imin << ", " << s.imax << "] x [" << s.jmin << ", " << s.jmax << "]";
+}
 
+typedef DistributedStencil<LineKernelUpdate<State>, GenerationStats> Life;
+typedef Life::Grid Grid;
+typedef Grid::Block Block;
+
+/**
+ * The board: its interior [1, H] x [1, W] on the stencil engine, each
+ * block keeping the statistics of its latest generation. The grid's halos
+ * on the board edge are never written and stay dead, which is the board's
+ * dead border.
+ */
+Life make_board(long height, long width, const Rule& rule) {
+    return Life(height, width, LineKernelUpdate<State>{ select_line_kernel("auto", rule), rule },
+                FLAGS_block, State::Dead);
 }
 
-    using namespace Grappa;
+/**
+ * Every core maps and parses the pattern file itself and writes only the
+ * live cells of its own blocks, so placing a pattern sends no cell over the
+ * network. The pattern is centred on the board; cells falling off it are
+ * dropped.
+ *
+ * The price is that every core parses the whole file, keeping only its
+ * own cells, so loading costs the file's size times the number of cores,
+ * and every process must see the file at the same path (a shared file
+ * system). Fine for patterns far smaller than the board; for huge ones,
+ * parse once and send each owner its runs.
+ */
+void load_pattern(const Grid& grid, const std::string& path) {
+    char fname[256];
+    if (path.size() >= sizeof(fname)) throw std::runtime_error("pattern path too long: " + path);
+    strcpy(fname, path.c_str());
+
+    const Grid g = grid;
+    on_all_cores([g, fname]{
+        Pattern pattern(fname);
+        const long height = g.height(), width = g.width();
+        const long i0 = 1 + std::max(0L, (height - pattern.rows()) / 2);
+        const long j0 = 1 + std::max(0L, (width - pattern.cols()) / 2);
+        pattern.runs([&](long row, long col, long length) {
+            long i = i0 + row;
+            if (i < 1 || i > height) return;
+            for (long j = std::max(j0 + col, 1L); j < std::min(j0 + col + length, width + 1); j++)
+                if (g.owner(i,j) == mycore()) g.local_cell(i,j) = State::Alive;
+        });
+    });
+}
 
+/**
+ * A random soup, the same as life's for the same seed: every core fills
+ * its own blocks from the hash of each cell's coordinates.
+ */
+void load_soup(const Grid& grid, double density, uint64_t seed) {
+    const Grid g = grid;
+    on_all_cores([g, density, seed]{
+        for (Block& blk : g.mine().blocks)
+            for (long i = blk.i0; i < blk.i0 + blk.rows; i++)
+                for (long j = blk.j0; j < blk.j0 + blk.cols; j++)
+                    if (soup_alive(seed, i, j, density)) blk.at(i, j) = State::Alive;
+    });
+}
 
-const int grid_height = 3;
-const int grid_width  = 3;
-const int iterations  = 10;
+GenerationStats generation_stats;      // of the latest generation, the same on every core
+
+/**
+ * The statistics of the current board as it stands, births and deaths
+ * zero; for generation 0 and boards edited between steps.
+ */
+GenerationStats census(const Grid& grid) {
+    const Grid g = grid;
+    on_all_cores([g]{
+        GenerationStats mine;
+        for (Block& b : g.mine().blocks)
+            for (long r = 1; r <= b.rows; r++)
+                mine.tally(b.row(r), b.row(r), 1, b.cols + 1, b.i0 + r - 1, b.j0);
+        generation_stats = allreduce<GenerationStats, GenerationStats::combine>(mine);
+    });
+    return generation_stats;
+}
 
-using namespace Spaces;
+/**
+ * Tallies a generation as Life::step() computes it: every block's
+ * statistics start over when it is stepped and take each row as it comes,
+ * an unchanged interior as it stands. A skipped block keeps its population
+ * and bounding box with no births or deaths, and a block changed if
+ * anything was born or died in it. Then one allreduce.
+ */
+struct Tally : Life::Observer {
+    void begin(Block& b, Block& out) const { out.info = GenerationStats(); }
+
+    void row(Block& b, Block& out, long r, long c0, long c1) const {
+        out.info.tally(b.row(r), out.row(r), c0, c1, b.i0 + r - 1, b.j0);
+    }
 
-    // init_game(grid_height, grid_width);
+    void kept(Block& b, Block& out, long r0, long r1, long c0, long c1) const {
+        if (c0 >= c1) return;
+        for (long r = r0; r <= r1; r++) out.info.tally(b.row(r), b.row(r), c0, c1, b.i0 + r - 1, b.j0);
+    }
 
-Domain  grid_domain(
-        Spaces::Range(grid_height + 2),
-        Spaces::Range(grid_width + 2)
-);
+    void skipped(Block& b, Block& out) const {
+        out.info = b.info;
+        out.info.births = out.info.deaths = 0;
+    }
 
-Subdomain  compute_domain(grid_domain);
+    long end(Block& b, Block& out) const { return out.info.births + out.info.deaths; }
 
-Board     board;
+    void finish(const Grid& to) const {
+        GenerationStats mine;
+        for (Block& b : to.mine().blocks) mine = GenerationStats::combine(mine, b.info);
+        generation_stats = allreduce<GenerationStats, GenerationStats::combine>(mine);
+    }
+};
 
-void init_game() {
-    
+// One generation; returns its statistics.
+GenerationStats step(Life& life) {
+    life.step(1, Tally());
+    return generation_stats;
+}
 
-    Board _board(grid_domain);
+/**
+ * Moves block ownership so every core gets about the same work. Each block
+ * is weighed by what its next step will cost: its cells if it or one of its
+ * neighbours changed last generation, so step() will visit it, and next
+ * to nothing if not. Every core learns which blocks changed and weighs all
+ * of them alike; the blocks are then cut into runs of equal weight in id
+ * order. Both buffers move together: a moving block's cells in each go to
+ * the new owner in one message.
+ */
+void rebalance(const Life& life) {
+    const Life l = life;
+    on_all_cores([l]{
+        const Grid& current = l.grid();
+        std::vector<double> changed = current.gather_weights([](Block& b) {
+            return b.activity ? 1.0 : 0.0;
+        });
+        const BlockLayout& layout = current.layout;
+        std::vector<double> weights(layout.blocks());
+        for (long b = 0; b < layout.blocks(); b++) {
+            bool visited = changed[b] != 0;
+            for (int dr = -1; dr <= 1; dr++)
+                for (int dc = -1; dc <= 1; dc++) {
+                    long nb = layout.neighbour(b, dr, dc);
+                    if (nb >= 0 && changed[nb] != 0) visited = true;
+                }
+            weights[b] = 1.0 + (visited ? layout.rows_of(b) * layout.cols_of(b) : 0);
+        }
+        std::vector<Core> owners = Grid::balanced_owners(weights, cores());
+        long moved = l.migrate(owners);
+        DVLOG(2) << "core " << mycore() << " handed off " << moved << " blocks";
+    });
+}
 
-    on_all_cores([=]{
-        board = _board;
+/**
+ * Counts live cells per block of `grid`: every core counts its own cells
+ * into a local grid, then adds each non-zero count to the shared counters
+ * with one async increment, and the master reads one counter per block.
+ */
+void sample(const Grid& board, DensityGrid& grid) {
+    const long nblocks = grid.rows() * grid.cols();
+    GlobalAddress<uint32_t> counts = global_alloc<uint32_t>(nblocks);
+    forall(counts, nblocks, [](uint32_t& c) { c = 0; });
+
+    const BlockMap g = grid.blocks();
+    const Grid b = board;
+    on_all_cores([counts, g, nblocks, b]{
+        std::vector<uint32_t> mine(nblocks, 0);
+        for (Block& blk : b.mine().blocks)
+            for (long i = blk.i0; i < blk.i0 + blk.rows; i++)
+                for (long j = blk.j0; j < blk.j0 + blk.cols; j++)
+                    if (blk.at(i,j) == State::Alive) mine[g.block_of(i,j)]++;
+        for (long k = 0; k < nblocks; k++)
+            if (mine[k]) delegate::increment<async>(counts + k, mine[k]);
     });
 
+    for (long k = 0; k < nblocks; k++) grid.set_block(k, delegate::read(counts + k));
+    global_free(counts);
 }
-  
-size_t count_alive(Spaces::Range x, Spaces::Range y) {
-    size_t total = 0;
-    // for (int i = x.lower; i <= x.upper; i++) {
-    //     for (int j = y.lower; j <= y.upper; j++) {
-    //         if(board.get(i,j) == State::Alive) {
-    //             // std::cout << i << ", " << j << " is alive\n";
-    //             total++;  
-    //         }
-
-    //     }
-    // }
-
-    std::cout << "counting...";
-
-    GlobalAddress<size_t> counter = global_alloc<size_t>(1);
-    delegate::write(counter, 0);
-
-    // we know that it's row-major
-    for(long j = 0; j < y.width(); j++){
-        Grappa::forall<async>(
-            // first upper right cell
-            board.get(x.lower,j),
-            // for as many cells are in the horizontal range
-            x.width(),
-            [counter](State& v){
-                if (v == State::Alive) 
-                    delegate::increment<async>(counter,1);
-            });
-    };
-
-    total = delegate::read(counter);
-    global_free(counter);
-    return total;
-}
-  
-
-// Spaces::Board::Cell operator()(const size_t& x,  const size_t& y) {
-//     return board(x,y);
-// }
-
-
-void step() {
-    Spaces::Board temp_board(compute_domain);
-    // size_t i,j;
-    // for (long i = 0; i < grid_domain.x.upper; i++) {
-    //     for (long j = 0; j < grid_domain.y.upper; j++) {
-    board.forall_cells([temp_board](std::pair<long, long> coords, State& value){
-        long i,j;
-        std::tie(i,j) = coords; 
-        bool is_alive = value == State::Alive;
-        size_t num_alive = count_alive(Spaces::Range(i-1,i+1), Spaces::Range(j-1, j+1) );
-        delegate::write<async>(
-            temp_board.get(i,j), 
-            ( (2 == num_alive && is_alive) || num_alive == 3 ) ? State::Alive : State::Dead 
-        );
-    });
 
-    //         bool is_alive = board.get(i,j) == State::Alive;
-    //         size_t num_alive = count_alive( Spaces::Range(i-1,i+1), Spaces::Range(j-1, j+1) );
-    //         if (is_alive) num_alive--;
-    //         // std::cout << i << ", " << j <<  ": num_alive = " << num_alive 
-    //         //           << " => " << (( (2 == num_alive && is_alive) || num_alive == 3 ) ? "alive" : "dead") << "\n"; 
-    //         temp_board(i,j) = ( (2 == num_alive && is_alive) || num_alive == 3 ) ? State::Alive : State::Dead ;
-    //     }
-    // }
-
-    board &= temp_board;
-
-} 
-
-void pretty_print() {
-    std::this_thread::sleep_for(std::chrono::milliseconds(500));
-    std::cout << (char)27 << "[2J" << (char)(27) << "[;H";
-    for (long i = 0; i < grid_domain.x.upper; i++) {
-        for (long j = 0; j < grid_domain.y.upper; j++) {
-            if (i == 0 || i == grid_domain.x.upper - 1) std::cout << "-";
-            else if (j == 0 || j == grid_domain.y.upper - 1) std::cout << "|";
-            else std::cout << ( delegate::read(board.get(i,j)) == State::Alive? "#" : " " );
-        }
-        std::cout << "\n";
+void show(const Grid& board, DensityGrid& screen, DensityGrid& image, long generation) {
+    if (FLAGS_pgm_every > 0 && generation % FLAGS_pgm_every == 0) {
+        sample(board, image);
+        image.write_pgm(pgm_name(FLAGS_pgm_prefix, generation));
+    }
+    if (!FLAGS_headless) {
+        if (generation > 0) std::this_thread::sleep_for(std::chrono::milliseconds(FLAGS_delay_ms));
+        sample(board, screen);
+        screen.print();
     }
-
 }
- 
-
 
 
 void main_body() {
-    init_game();
-    board(grid_height/2 + 1, grid_width/2    ) = State::Alive;
-    board(grid_height/2 + 1, grid_width/2 + 1) = State::Alive;
-    board(grid_height/2 + 1, grid_width/2 + 2) = State::Alive;
-    //game(grid_height/2, grid_width/2) = State::Alive;
-    //game(grid_height/2-1, grid_width/2-1) = State::Alive;
-    //game(grid_height/2+1, grid_width/2+1) = State::Alive;
-        
-    pretty_print();
-
-    for (int i = 0; i < iterations; i++) {
-        step();
-        pretty_print();
-        std::cout << i;
+    Rule rule = Rule::parse(FLAGS_rule);
+    SnapshotFormat snapshot_format = parse_snapshot_format(FLAGS_snapshot_format);
+    long first = 0;     // the generation the board starts at
+    if (!FLAGS_resume.empty()) {
+        SnapshotHeader h = read_snapshot_header(FLAGS_resume);
+        FLAGS_height = h.height;
+        FLAGS_width = h.width;
+        rule = Rule(h.birth, h.survive);
+        first = h.generation;
+    }
+
+    const long grid_height = FLAGS_height, grid_width = FLAGS_width;
+    Life life = make_board(grid_height, grid_width, rule);
+    if (!FLAGS_resume.empty()) {
+        load_snapshot(life.grid(), FLAGS_resume);
+    } else if (!FLAGS_pattern.empty()) {
+        load_pattern(life.grid(), FLAGS_pattern);
+    } else if (FLAGS_soup > 0) {
+        load_soup(life.grid(), FLAGS_soup, FLAGS_soup_seed);
+    } else {
+        life.set(grid_height/2 + 1, grid_width/2    , State::Alive);
+        life.set(grid_height/2 + 1, grid_width/2 + 1, State::Alive);
+        life.set(grid_height/2 + 1, grid_width/2 + 2, State::Alive);
+    }
+
+    long term_rows, term_cols;
+    terminal_size(&term_rows, &term_cols);
+    DensityGrid screen(grid_height, grid_width, term_rows - 3, term_cols - 2);
+    DensityGrid image(grid_height, grid_width, FLAGS_pgm_max, FLAGS_pgm_max);
+
+    show(life.grid(), screen, image, first);
+    GenerationStats stats = census(life.grid());
+    if (FLAGS_stats) std::cout << "generation " << first << ": " << stats << "\n";
+    double stepping = 0;
+    for (long i = 1; i <= FLAGS_generations; i++) {
+        const long generation = first + i;
+        double start = walltime();
+        stats = step(life);
+        if (FLAGS_rebalance_every > 0 && i % FLAGS_rebalance_every == 0) rebalance(life);
+        stepping += walltime() - start;
+        show(life.grid(), screen, image, generation);
+        if (FLAGS_stats) std::cout << "generation " << generation << ": " << stats << "\n";
+        if (FLAGS_snapshot_every > 0 && generation % FLAGS_snapshot_every == 0)
+            write_snapshot(life.grid(), snapshot_name(FLAGS_snapshot_prefix, generation), snapshot_format, generation, rule);
+    }
+
+    if (FLAGS_headless) {
+        double gens = FLAGS_generations;
+        std::cout << grid_height << "x" << grid_width << " on " << cores() << " cores: "
+                  << gens << " generations in " << stepping << " s, "
+                  << gens / stepping << " generations/s, "
+                  << gens * grid_height * grid_width / stepping << " cell updates/s, "
+                  << "final population " << stats.population << "\n";
     }
 
+    life.destroy();
 }
 
 int main(int argc, char* argv[])
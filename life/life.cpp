@@ -4,221 +4,162 @@
 #include <array>
 #include <chrono>
 #include <thread>
-
-enum class State { Dead, Alive };
-
-
-namespace Spaces {
-
-    struct Range {
-        long lower = 0, upper = 0;
-        size_t width() { return upper-lower; }
-        // Range() {}
-        Range(long upper_) : upper(upper_) {
-            // std::cout << "range created: " << width() << "\n";
-        }
-        Range(long lower_, long upper_) : lower(lower_), upper(upper_) {}
-        Range(const Spaces::Range& r): lower(r.lower), upper(r.upper) {}
-        size_t normalized(long i) {
-            return i - lower;
-        }
-
-    };
-
-
-    struct Domain {
-        Range x, y;
-        Domain(const Domain& d) : x(d.x), y(d.y) {}
-        Domain(Range x_, Range y_)  : x(x_), y(y_) {
-            // std::cout << "domain created: " << x.width() << " x " << y.width() << "\n";
-        }
-        size_t size() {
-            return x.width() * y.width();
-        }
-    };
-
-
-    struct Subdomain : public Domain {
-        
-        Subdomain(Domain domain_) :  Domain::Domain(domain_)  {}
-        
-        void expand(long amount) {
-            x.lower -= amount; 
-            y.upper += amount;
-        }
-    };
-
-    struct Board {
-        Domain domain;
-        State* values;
-
-        Board(Domain domain_) : domain(domain_) , values(new State[domain_.size()]) {
-            for (int i = 0; i < domain_.size(); i++) values[i] = State::Dead;
-        }
-        Board(Domain domain_, State* values_) : domain(domain_), values(values_) {}
-
-
-        long project(long i, long j) {
-            long result = domain.x.normalized(i) + domain.x.width() * domain.y.normalized(j);
-
-            // std::cout << i << ", " << j << " -> " << result << "\n";
-
-            return result;
-        }
-
-        State& get(long i, long j) {
-            // std::cout << i << "," << j << "\n";
-            // assert ( i >= domain.x.lower && i < domain.x.upper 
-            //         && j >= domain.y.lower && j < domain.y.upper );
-
-            // std::cout << i << ", " << j << " -> " 
-            //           << ((values[ project(i,j) ] == State::Alive)? "alive":"dead") << "\n";
-
-            return values[ project(i,j) ];
-        }
-
-        State& operator()(long i, long j) {
-            return get(i,j);
-        }
-
-        // Board& slice(Range xx, Range yy) {
-        //     Domain new_domain(xx, yy);
-        //     Board new_board (new_domain);    
-
-        //     // quick&dirty: this should become a memcpy!                        
-        //     for (int i = new_board.domain.x.lower; i < domain.x.upper; i++) {
-        //         for (int j = new_board.domain.y.lower; j < domain.y.upper; j++) {
-        //             new_board(i,j) = get(i,j);
-        //         }
-        //     }
-
-        //     return new_board;
-        // }
-
-        // Board& operator()(Range xx, Range yy) {
-        //     return slice(xx,yy);
-        // }
-
-        // Board& operator()(Domain xy) {
-        //     return slice(xy.x,xy.y);
-        // }
-
-        void assign(Board value) {
-            // quick&dirty: this should become a memcpy!                        
-            for (int i = value.domain.x.lower; i < value.domain.x.upper; i++) {
-                for (int j = value.domain.y.lower; j < value.domain.y.upper; j++) {
-                    get(i,j) = value.get(i,j);
-                }
-            }
-
-        }
-
-
-    };
-
+#include <algorithm>
+#include <cstring>
+#include <vector>
+
+// one byte per cell, so the line kernels can treat a board line as uint8_t
+enum class State : uint8_t { Dead, Alive };
+
+#include "BandPool.hpp"
+#include "BitGame.hpp"
+#include "Game.hpp"
+#include "HashLife.hpp"
+#include "Patterns.hpp"
+#include "LineKernels.hpp"
+#include "Render.hpp"
+#include "Rule.hpp"
+
+DEFINE_string(engine, "cells", "stepping engine: 'cells' (one State per cell), 'bits' (64 cells per word), 'hash' (hashlife) or 'stencil' (the generic stencil engine)");
+DEFINE_int64(threads, 1, "threads stepping the board, each owning a band of lines");
+DEFINE_string(simd, "auto", "cells engine kernel: auto, avx512, avx2 or scalar");
+DEFINE_int64(depth, 1, "cells engine: generations per pass over a cache-resident tile (temporal blocking, at most 32)");
+DEFINE_int64(hash_nodes, 1 << 22, "hash engine: cached nodes before a garbage collection");
+DEFINE_string(rule, "B3/S23", "birth/survival rule, e.g. B36/S23 for HighLife");
+DEFINE_string(pattern, "", "RLE, plaintext or Life 1.06 file to start from instead of the blinker");
+DEFINE_double(soup, 0, "fill the board at random with this share of live cells instead of the blinker (0: off)");
+DEFINE_int64(soup_seed, 1, "seed for --soup");
+DEFINE_int64(height, 10, "board height in cells");
+DEFINE_int64(width, 10, "board width in cells");
+DEFINE_int64(generations, 3, "generations to run");
+DEFINE_int64(frame_every, 1, "generations between frames (a power of two is a single hashlife jump)");
+DEFINE_bool(headless, false, "no frames: time the run and report generations/s and cell updates/s");
+DEFINE_int64(delay_ms, 500, "pause between frames");
+DEFINE_int64(pgm_every, 0, "write a PGM frame every this many generations (0: never)");
+DEFINE_string(pgm_prefix, "life", "PGM frames are written to <prefix>-<generation>.pgm");
+DEFINE_int64(pgm_max, 0, "downsample PGM frames to at most this many pixels per side (0: one per cell)");
+
+
+// Fills `grid` with the live cells of any engine exposing alive(i,j).
+template <typename G>
+void sample(DensityGrid& grid, G& game, long height, long width) {
+    grid.clear();
+    for (long i = 1; i <= height; i++)
+        for (long j = 1; j <= width; j++)
+            if (game.alive(i,j)) grid.add(i,j);
 }
 
+// Hashlife visits only live cells.
+void sample(DensityGrid& grid, HashLife& game, long height, long width) {
+    grid.clear();
+    game.for_each_alive([&](long i, long j) {
+        if (i >= 1 && i <= height && j >= 1 && j <= width) grid.add(i,j);
+    });
+}
 
-class Game {
-    Spaces::Domain grid_domain;
-    Spaces::Subdomain compute_domain;
-    Spaces::Board board;
-
-public:
-    Game(size_t height, size_t width) :
-        grid_domain({ 
-            Spaces::Range(height + 2),
-            Spaces::Range(width + 2)
-        }),
-
-        compute_domain(grid_domain),
-
-        board(grid_domain) { }
-        
-
-    State& operator()(const size_t& x,  const size_t& y) {
-        return board(x,y);
-    }
-
-    size_t count_alive(Spaces::Range x, Spaces::Range y) {
-        size_t total = 0;
-        for (int i = x.lower; i <= x.upper; i++) {
-            for (int j = y.lower; j <= y.upper; j++) {
-                if(board.get(i,j) == State::Alive) {
-                    // std::cout << i << ", " << j << " is alive\n";
-                    total++;  
-                }
-
-            }
-        }
-        return total;
+// n generations; Game and HashLife take them in one call (temporal blocks, jumps).
+template <typename G>
+void advance(G& game, long n) { for (long k = 0; k < n; k++) game.step(); }
+
+void advance(Game& game, long n) { game.step(n); }
+void advance(HashLife& game, long n) { game.step(n); }
+void advance(StencilGame& game, long n) { game.step(n); }
+
+/**
+ * Runs --generations generations, --frame_every at a time. Interactive runs
+ * draw a frame (downsampled to the terminal) after each batch; headless runs
+ * only time the stepping and report generations and cell updates per
+ * second. Either way a PGM frame is written every --pgm_every generations.
+ */
+template <typename G>
+void play(G& game) {
+    const long height = FLAGS_height, width = FLAGS_width;
+
+    if (!FLAGS_pattern.empty()) {
+        long cells = place_pattern(game, FLAGS_pattern, height, width);
+        DVLOG(1) << "placed " << cells << " live cells from " << FLAGS_pattern;
+    } else if (FLAGS_soup > 0) {
+        long cells = place_soup(game, height, width, FLAGS_soup, FLAGS_soup_seed);
+        DVLOG(1) << "placed " << cells << " live cells at random";
+    } else {
+        game.set(height/2 + 1, width/2    , true);
+        game.set(height/2 + 1, width/2 + 1, true);
+        game.set(height/2 + 1, width/2 + 2, true);
     }
 
+    long term_rows, term_cols;
+    terminal_size(&term_rows, &term_cols);
+    DensityGrid screen(height, width, term_rows - 3, term_cols - 2);
+    long pgm_side = FLAGS_pgm_max > 0 ? FLAGS_pgm_max : std::max(height, width);
+    DensityGrid image(height, width, pgm_side, pgm_side);
 
-    void step() {
-        Spaces::Board temp_board(compute_domain);
-        // forall (size_t i, size_t j) {
-        size_t i,j;
-        for (long i = 0; i < grid_domain.x.upper; i++) {
-            for (long j = 0; j < grid_domain.y.upper; j++) {
-                bool is_alive = board.get(i,j) == State::Alive;
-                size_t num_alive = count_alive( Spaces::Range(i-1,i+1), Spaces::Range(j-1, j+1) );
-                if (is_alive) num_alive--;
-                // std::cout << i << ", " << j <<  ": num_alive = " << num_alive 
-                //           << " => " << (( (2 == num_alive && is_alive) || num_alive == 3 ) ? "alive" : "dead") << "\n"; 
-                temp_board(i,j) = ( (2 == num_alive && is_alive) || num_alive == 3 ) ? State::Alive : State::Dead ;
-            }
+    auto show = [&](long generation) {
+        if (FLAGS_pgm_every > 0 && generation % FLAGS_pgm_every == 0) {
+            sample(image, game, height, width);
+            image.write_pgm(pgm_name(FLAGS_pgm_prefix, generation));
         }
-
-        board.assign(temp_board);
-
-    } 
-
-    void pretty_print() {
-        std::this_thread::sleep_for(std::chrono::milliseconds(500));
-        std::cout << (char)27 << "[2J" << (char)(27) << "[;H";
-        for (long i = 0; i < grid_domain.x.upper; i++) {
-            for (long j = 0; j < grid_domain.y.upper; j++) {
-                if (i == 0 || i == grid_domain.x.upper - 1) std::cout << "-";
-                else if (j == 0 || j == grid_domain.y.upper - 1) std::cout << "|";
-                else std::cout << ( board.get(i,j) == State::Alive? "#" : " " );
-            }
-            std::cout << "\n";
+        if (!FLAGS_headless) {
+            if (generation > 0) std::this_thread::sleep_for(std::chrono::milliseconds(FLAGS_delay_ms));
+            sample(screen, game, height, width);
+            screen.print();
         }
+    };
 
+    // batches end on frames and on PGM dumps
+    long batch = std::max(1L, (long) FLAGS_frame_every);
+    if (FLAGS_headless) batch = FLAGS_pgm_every > 0 ? FLAGS_pgm_every : std::max(1L, (long) FLAGS_generations);
+
+    show(0);
+    double stepping = 0;
+    for (long done = 0; done < FLAGS_generations; ) {
+        long n = std::min(batch, FLAGS_generations - done);
+        if (FLAGS_pgm_every > 0) n = std::min(n, FLAGS_pgm_every - done % FLAGS_pgm_every);
+        double start = Grappa::walltime();
+        advance(game, n);
+        stepping += Grappa::walltime() - start;
+        done += n;
+        show(done);
     }
- 
-
-
-};
-
-const int grid_height = 10;
-const int grid_width = 10;
 
+    if (FLAGS_headless) {
+        double gens = FLAGS_generations;
+        std::cout << FLAGS_engine << " " << height << "x" << width << ": "
+                  << gens << " generations in " << stepping << " s, "
+                  << gens / stepping << " generations/s, "
+                  << gens * height * width / stepping << " cell updates/s\n";
+    }
+}
 
 void main_body() {
-    auto game = Game::Game(grid_height,grid_width);
-    game(grid_height/2 + 1, grid_width/2    ) = State::Alive;
-    game(grid_height/2 + 1, grid_width/2 + 1) = State::Alive;
-    game(grid_height/2 + 1, grid_width/2 + 2) = State::Alive;
-        
-    game.pretty_print();
-
-    for (int i = 0; i < 3; i++) {
-        game.step();
-        game.pretty_print();
+    Rule rule = Rule::parse(FLAGS_rule);
+    DVLOG(1) << "rule: " << rule.name();
+
+    if (FLAGS_engine == "bits") {
+        BitGame game(FLAGS_height, FLAGS_width, FLAGS_threads, rule);
+        play(game);
+    } else if (FLAGS_engine == "hash") {
+        HashLife game(FLAGS_hash_nodes, rule);
+        play(game);
+    } else {
+        std::string kernel_name;
+        LineKernel kernel = select_line_kernel(FLAGS_simd, rule, &kernel_name);
+        DVLOG(1) << "line kernel: " << kernel_name;
+        if (FLAGS_engine == "stencil") {
+            StencilGame game(FLAGS_height, FLAGS_width, FLAGS_threads, kernel, rule);
+            play(game);
+        } else {
+            Game game(FLAGS_height, FLAGS_width, FLAGS_threads, kernel, FLAGS_depth, rule);
+            play(game);
+        }
     }
-
 }
 
 int main(int argc, char* argv[])
 {
-            main_body();
-
-    // Grappa::init(&argc, &argv);
-    // Grappa::run([]{
-    //     main_body();
-    // });
-    // Grappa::finalize();
+    Grappa::init(&argc, &argv);
+    Grappa::run([]{
+        main_body();
+    });
+    Grappa::finalize();
     return 0;
 }
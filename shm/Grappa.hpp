@@ -0,0 +1,617 @@
+#pragma once
+
+// Shared-memory stand-in for the subset of the Grappa API used in this repo.
+//
+// Compiling against this header (-I../shm instead of the Grappa include
+// paths) runs the same programs on a single node with plain threads: one
+// worker thread per "core", a work-stealing pool behind forall, and
+// GlobalAddress<T> reduced to a raw pointer. No MPI, glog or gflags needed.
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <iostream>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <sstream>
+#include <string>
+#include <thread>
+#include <type_traits>
+#include <utility>
+#include <vector>
+#include <chrono>
+#include <cmath>
+#include <algorithm>
+
+namespace Grappa {
+namespace shm {
+
+    // ---- logging (glog subset) ----------------------------------------------
+
+    extern int32_t verbosity;
+
+    struct LogLine {
+        std::ostringstream out;
+        bool fatal;
+        LogLine(bool fatal_ = false) : fatal(fatal_) {}
+        ~LogLine() {
+            out << "\n";
+            std::cerr << out.str();
+            if (fatal) std::abort();
+        }
+        std::ostream& stream() { return out; }
+    };
+
+    // ---- flags (gflags subset) ----------------------------------------------
+
+    struct Flag {
+        std::function<void(const std::string&)> set;
+        bool is_bool;
+        std::string help, initial;
+    };
+
+    inline std::map<std::string, Flag>& flags() {
+        static std::map<std::string, Flag> registry;
+        return registry;
+    }
+
+    struct FlagRegistration {
+        template <typename T>
+        static std::string show(const T& v) { std::ostringstream o; o << v; return o.str(); }
+        static std::string show(const std::string& v) { return "\"" + v + "\""; }
+        static std::string show(bool v) { return v ? "true" : "false"; }
+
+        FlagRegistration(const char* name, int64_t* v, const char* help) {
+            flags()[name] = Flag{ [v](const std::string& s){ *v = std::stoll(s); }, false, help, show(*v) };
+        }
+        FlagRegistration(const char* name, int32_t* v, const char* help) {
+            flags()[name] = Flag{ [v](const std::string& s){ *v = std::stoi(s); }, false, help, show(*v) };
+        }
+        FlagRegistration(const char* name, double* v, const char* help) {
+            flags()[name] = Flag{ [v](const std::string& s){ *v = std::stod(s); }, false, help, show(*v) };
+        }
+        FlagRegistration(const char* name, std::string* v, const char* help) {
+            flags()[name] = Flag{ [v](const std::string& s){ *v = s; }, false, help, show(*v) };
+        }
+        FlagRegistration(const char* name, bool* v, const char* help) {
+            flags()[name] = Flag{ [v](const std::string& s){
+                *v = !(s == "false" || s == "0" || s == "no");
+            }, true, help, show(*v) };
+        }
+    };
+
+    // gflags-style --help: every flag with its help text and default.
+    inline void print_help(const char* program) {
+        std::cout << program << ": flags\n";
+        for (auto& f : flags())
+            std::cout << "  --" << f.first << " (" << f.second.help << ") default: "
+                      << f.second.initial << "\n";
+    }
+
+    // Accepts --name=value, --name value, --flag and --noflag; anything
+    // that is not a registered flag is left in argv for the program.
+    inline void parse_flags(int* argc, char*** argv) {
+        int kept = 1;
+        for (int i = 1; i < *argc; i++) {
+            std::string arg = (*argv)[i];
+            if (arg.compare(0, 2, "--") != 0) { (*argv)[kept++] = (*argv)[i]; continue; }
+            arg = arg.substr(2);
+            if (arg == "help") { print_help((*argv)[0]); std::exit(0); }
+            std::string name = arg, value;
+            bool has_value = false;
+            size_t eq = arg.find('=');
+            if (eq != std::string::npos) {
+                name = arg.substr(0, eq); value = arg.substr(eq + 1); has_value = true;
+            }
+            auto it = flags().find(name);
+            if (it == flags().end() && name.compare(0, 2, "no") == 0) {
+                auto neg = flags().find(name.substr(2));
+                if (neg != flags().end() && neg->second.is_bool) {
+                    neg->second.set("false");
+                    continue;
+                }
+            }
+            if (it == flags().end()) { (*argv)[kept++] = (*argv)[i]; continue; }
+            if (!has_value) {
+                if (it->second.is_bool) value = "true";
+                else if (i + 1 < *argc) value = (*argv)[++i];
+            }
+            it->second.set(value);
+        }
+        *argc = kept;
+    }
+
+} // namespace shm
+} // namespace Grappa
+
+#define LOG(severity) Grappa::shm::LogLine(std::string(#severity) == "FATAL").stream()
+#define VLOG(n) if ((n) > Grappa::shm::verbosity) {} else Grappa::shm::LogLine().stream()
+#ifdef NDEBUG
+#define DVLOG(n) if (true) {} else Grappa::shm::LogLine().stream()
+#else
+#define DVLOG(n) VLOG(n)
+#endif
+#define CHECK(cond) if (cond) {} else LOG(FATAL) << "Check failed: " #cond " "
+#define CHECK_EQ(a, b) CHECK((a) == (b))
+#define CHECK_LT(a, b) CHECK((a) < (b))
+#define CHECK_LE(a, b) CHECK((a) <= (b))
+#define CHECK_GT(a, b) CHECK((a) > (b))
+#define CHECK_GE(a, b) CHECK((a) >= (b))
+
+#define SHM_DEFINE_FLAG(type, name, value, help)                                   \
+    type FLAGS_##name = value;                                                 \
+    static Grappa::shm::FlagRegistration shm_flag_##name(#name, &FLAGS_##name, help)
+#define DEFINE_int64(name, value, help)  SHM_DEFINE_FLAG(int64_t, name, value, help)
+#define DEFINE_int32(name, value, help)  SHM_DEFINE_FLAG(int32_t, name, value, help)
+#define DEFINE_uint64(name, value, help) SHM_DEFINE_FLAG(int64_t, name, value, help)
+#define DEFINE_double(name, value, help) SHM_DEFINE_FLAG(double, name, value, help)
+#define DEFINE_bool(name, value, help)   SHM_DEFINE_FLAG(bool, name, value, help)
+#define DEFINE_string(name, value, help) SHM_DEFINE_FLAG(std::string, name, value, help)
+#define DECLARE_int64(name)  extern int64_t FLAGS_##name
+#define DECLARE_int32(name)  extern int32_t FLAGS_##name
+#define DECLARE_double(name) extern double FLAGS_##name
+#define DECLARE_bool(name)   extern bool FLAGS_##name
+#define DECLARE_string(name) extern std::string FLAGS_##name
+
+namespace Grappa {
+
+typedef int16_t Core;
+
+enum class SyncMode { Blocking, Async };
+constexpr SyncMode async = SyncMode::Async;
+
+namespace shm {
+
+    // ---- work-stealing pool ---------------------------------------------------
+
+    struct Task {
+        std::function<void()> run;
+        std::atomic<int64_t>* pending;
+    };
+
+    struct Worker {
+        std::mutex lock;
+        std::deque<Task> tasks;          // owner pops at the back, thieves take the front
+        std::function<void()> pinned;    // on_all_cores body, only ever run by this worker
+        bool has_pinned = false;
+    };
+
+    struct Pool {
+        int ncores = 1;
+        std::vector<std::unique_ptr<Worker>> workers;
+        std::vector<std::thread> threads;
+        std::mutex idle_lock;
+        std::condition_variable idle;
+        bool stopping = false;
+
+        // barrier state
+        std::mutex barrier_lock;
+        std::condition_variable barrier_cv;
+        int barrier_count = 0;
+        int64_t barrier_generation = 0;
+
+        std::atomic<int64_t> messages{0};   // heap messages queued, not yet delivered
+    };
+
+    extern Pool pool;
+    extern thread_local Core current_core;
+
+    inline void execute(Task& t) {
+        t.run();
+        t.pending->fetch_sub(1);
+    }
+
+    inline bool try_pop(Core self, Task& out) {
+        {
+            Worker& w = *pool.workers[self];
+            std::lock_guard<std::mutex> g(w.lock);
+            if (!w.tasks.empty()) {
+                out = std::move(w.tasks.back());
+                w.tasks.pop_back();
+                return true;
+            }
+        }
+        for (int k = 1; k < pool.ncores; k++) {
+            Worker& victim = *pool.workers[(self + k) % pool.ncores];
+            std::lock_guard<std::mutex> g(victim.lock);
+            if (!victim.tasks.empty()) {
+                out = std::move(victim.tasks.front());
+                victim.tasks.pop_front();
+                return true;
+            }
+        }
+        return false;
+    }
+
+    inline void push(Core target, Task t) {
+        {
+            Worker& w = *pool.workers[target];
+            std::lock_guard<std::mutex> g(w.lock);
+            w.tasks.push_back(std::move(t));
+        }
+        std::lock_guard<std::mutex> g(pool.idle_lock);
+        pool.idle.notify_all();
+    }
+
+    // Run queued tasks (own first, then stolen) until `pending` drains.
+    inline void help_until_done(std::atomic<int64_t>& pending) {
+        Task t;
+        while (pending.load() > 0) {
+            if (try_pop(current_core, t)) execute(t);
+            else std::this_thread::yield();
+        }
+    }
+
+    inline void worker_loop(Core self) {
+        current_core = self;
+        Worker& w = *pool.workers[self];
+        Task t;
+        for (;;) {
+            std::function<void()> pinned;
+            {
+                std::lock_guard<std::mutex> g(w.lock);
+                if (w.has_pinned) { pinned = std::move(w.pinned); w.has_pinned = false; }
+            }
+            if (pinned) { pinned(); continue; }
+            if (try_pop(self, t)) { execute(t); continue; }
+
+            std::unique_lock<std::mutex> g(pool.idle_lock);
+            if (pool.stopping) return;
+            pool.idle.wait_for(g, std::chrono::milliseconds(1));
+        }
+    }
+
+    inline void start(int ncores) {
+        pool.ncores = ncores < 1 ? 1 : ncores;
+        for (int i = 0; i < pool.ncores; i++) pool.workers.emplace_back(new Worker);
+        current_core = 0;   // the thread calling run() acts as core 0
+        for (int i = 1; i < pool.ncores; i++) pool.threads.emplace_back(worker_loop, (Core)i);
+    }
+
+    inline void stop() {
+        {
+            std::lock_guard<std::mutex> g(pool.idle_lock);
+            pool.stopping = true;
+            pool.idle.notify_all();
+        }
+        for (auto& t : pool.threads) t.join();
+        pool.threads.clear();
+        pool.workers.clear();
+    }
+
+    // Striped locks standing in for Grappa's per-core delegate serialization.
+    inline std::mutex& lock_for(const void* p) {
+        static std::mutex stripes[256];
+        uintptr_t h = reinterpret_cast<uintptr_t>(p);
+        return stripes[(h >> 6) & 255];
+    }
+
+    inline std::mutex& lock_for_core(Core c) {
+        static std::mutex stripes[256];
+        return stripes[c & 255];
+    }
+
+    // Runs f as core c, one such call per core at a time, the way Grappa
+    // runs delegates and messages on their (single-threaded) target core.
+    template <typename F>
+    auto as_core(Core c, F f) -> decltype(f()) {
+        struct Restore {
+            Core saved;
+            ~Restore() { current_core = saved; }
+        } restore{ current_core };
+        std::lock_guard<std::mutex> g(lock_for_core(c));
+        current_core = c;
+        return f();
+    }
+
+} // namespace shm
+
+inline Core cores()  { return (Core)shm::pool.ncores; }
+inline Core mycore() { return shm::current_core; }
+
+inline double walltime() {
+    using namespace std::chrono;
+    return duration<double>(steady_clock::now().time_since_epoch()).count();
+}
+
+} // namespace Grappa
+
+// ---- addresses ---------------------------------------------------------------
+
+template <typename T>
+class GlobalAddress {
+    T* ptr_ = nullptr;
+    Grappa::Core core_ = 0;
+    bool symmetric_ = false;
+public:
+    GlobalAddress() {}
+    GlobalAddress(T* p, Grappa::Core c = 0, bool symmetric = false)
+        : ptr_(p), core_(c), symmetric_(symmetric) {}
+
+    T* pointer() const { return symmetric_ ? ptr_ + Grappa::mycore() : ptr_; }
+    T* localize() const { return pointer(); }
+    Grappa::Core core() const { return core_; }
+    bool symmetric() const { return symmetric_; }
+    intptr_t raw_bits() const { return reinterpret_cast<intptr_t>(ptr_); }
+
+    T* operator->() const { return pointer(); }
+    T& operator*() const { return *pointer(); }
+    T& operator[](int64_t i) const { return pointer()[i]; }
+
+    GlobalAddress operator+(int64_t i) const { return GlobalAddress(ptr_ + i, core_); }
+    GlobalAddress operator-(int64_t i) const { return GlobalAddress(ptr_ - i, core_); }
+    int64_t operator-(const GlobalAddress& o) const { return ptr_ - o.ptr_; }
+    GlobalAddress& operator+=(int64_t i) { ptr_ += i; return *this; }
+    GlobalAddress& operator++() { ++ptr_; return *this; }
+
+    bool operator==(const GlobalAddress& o) const { return ptr_ == o.ptr_; }
+    bool operator!=(const GlobalAddress& o) const { return ptr_ != o.ptr_; }
+    bool operator<(const GlobalAddress& o) const { return ptr_ < o.ptr_; }
+    explicit operator bool() const { return ptr_ != nullptr; }
+};
+
+template <typename T>
+std::ostream& operator<<(std::ostream& o, const GlobalAddress<T>& a) {
+    return o << "<" << a.core() << ":" << (const void*)a.pointer() << ">";
+}
+
+template <typename T>
+GlobalAddress<T> make_global(T* p, Grappa::Core c = Grappa::mycore()) { return GlobalAddress<T>(p, c); }
+
+namespace Grappa {
+
+template <typename T>
+GlobalAddress<T> global_alloc(size_t n) { return GlobalAddress<T>(new T[n]()); }
+
+template <typename T>
+void global_free(GlobalAddress<T> a) {
+    if (a.symmetric()) ::operator delete(reinterpret_cast<void*>(a.raw_bits()));
+    else delete[] a.pointer();
+}
+
+// One T per core, left unconstructed as in Grappa; `->` and localize() resolve to the calling core's copy.
+template <typename T>
+GlobalAddress<T> symmetric_global_alloc() {
+    return GlobalAddress<T>(static_cast<T*>(::operator new(sizeof(T) * cores())), 0, true);
+}
+
+template <typename T>
+T* locale_alloc(size_t n = 1) { return new T[n]; }
+
+template <typename T>
+void locale_free(T* p) { delete[] p; }
+
+// ---- task parallelism -----------------------------------------------------
+
+class GlobalCompletionEvent {
+public:
+    void enroll(int64_t = 1) {}
+    void complete(int64_t = 1) {}
+    void wait() {}
+};
+
+namespace impl { extern GlobalCompletionEvent local_gce; }
+
+// A local counter of outstanding work: wait() returns once every enroll() is completed.
+class CompletionEvent {
+    std::atomic<int64_t> count{0};
+public:
+    void enroll(int64_t n = 1) { count += n; }
+    void complete(int64_t n = 1) { count -= n; }
+    // Runs queued tasks and messages meanwhile, as a Grappa task would yield to them.
+    void wait() {
+        shm::Task t;
+        while (count.load() > 0) {
+            if (shm::try_pop(shm::current_core, t)) shm::execute(t);
+            else std::this_thread::yield();
+        }
+    }
+    int64_t get_count() const { return count.load(); }
+};
+
+inline void barrier() {
+    auto& p = shm::pool;
+    std::unique_lock<std::mutex> g(p.barrier_lock);
+    int64_t gen = p.barrier_generation;
+    if (++p.barrier_count == p.ncores) {
+        p.barrier_count = 0;
+        p.barrier_generation++;
+        p.barrier_cv.notify_all();
+    } else {
+        p.barrier_cv.wait(g, [&]{ return p.barrier_generation != gen; });
+    }
+}
+
+// Runs f once on every core, concurrently; call it from the main task only.
+template <typename F>
+void on_all_cores(F f) {
+    auto& p = shm::pool;
+    std::atomic<int64_t> pending(p.ncores - 1);
+    for (int c = 1; c < p.ncores; c++) {
+        shm::Worker& w = *p.workers[c];
+        std::lock_guard<std::mutex> g(w.lock);
+        w.pinned = [f, &pending]{ f(); pending--; };
+        w.has_pinned = true;
+    }
+    {
+        std::lock_guard<std::mutex> g(p.idle_lock);
+        p.idle.notify_all();
+    }
+    Core saved = shm::current_core;
+    shm::current_core = 0;
+    f();
+    shm::current_core = saved;
+    shm::help_until_done(pending);
+}
+
+// forall over an index range, split into chunks that idle cores steal.
+template <SyncMode S = SyncMode::Blocking, GlobalCompletionEvent* C = &impl::local_gce, typename F>
+void forall(int64_t start, int64_t iters, F f) {
+    if (iters <= 0) return;
+    int64_t nchunks = std::min<int64_t>(iters, (int64_t)cores() * 8);
+    int64_t per = iters / nchunks, extra = iters % nchunks;
+    std::atomic<int64_t> pending(nchunks);
+    int64_t lo = start;
+    for (int64_t k = 0; k < nchunks; k++) {
+        int64_t hi = lo + per + (k < extra ? 1 : 0);
+        shm::push((Core)(k % cores()), shm::Task{ [f, lo, hi]() mutable {
+            for (int64_t i = lo; i < hi; i++) f(i);
+        }, &pending });
+        lo = hi;
+    }
+    shm::help_until_done(pending);
+}
+
+namespace shm {
+    template <typename T, typename F>
+    auto apply_elem(F& f, int64_t i, T& e, int) -> decltype(f(i, e), void()) { f(i, e); }
+    template <typename T, typename F>
+    auto apply_elem(F& f, int64_t, T& e, long) -> decltype(f(e), void()) { f(e); }
+}
+
+template <SyncMode S = SyncMode::Blocking, GlobalCompletionEvent* C = &impl::local_gce, typename T, typename F>
+void forall(GlobalAddress<T> base, int64_t nelems, F f) {
+    T* p = base.pointer();
+    forall<S, C>((int64_t)0, nelems, [p, f](int64_t i) mutable {
+        shm::apply_elem<T>(f, i, p[i], 0);
+    });
+}
+
+template <SyncMode S = SyncMode::Blocking, GlobalCompletionEvent* C = &impl::local_gce, typename F>
+void forall_here(int64_t start, int64_t iters, F f) {
+    for (int64_t i = start; i < start + iters; i++) f(i);
+}
+
+template <typename F>
+void spawn(F f) { f(); }
+
+template <typename F>
+void finish(F f) { f(); }
+
+// ---- delegates ------------------------------------------------------------
+
+namespace delegate {
+
+    template <SyncMode S = SyncMode::Blocking, GlobalCompletionEvent* C = &impl::local_gce, typename T>
+    T read(GlobalAddress<T> a) { return *a.pointer(); }
+
+    template <SyncMode S = SyncMode::Blocking, GlobalCompletionEvent* C = &impl::local_gce, typename T, typename U>
+    void write(GlobalAddress<T> a, U v) { *a.pointer() = v; }
+
+    template <SyncMode S = SyncMode::Blocking, GlobalCompletionEvent* C = &impl::local_gce, typename T, typename U>
+    T fetch_and_add(GlobalAddress<T> a, U inc) {
+        std::lock_guard<std::mutex> g(shm::lock_for(a.pointer()));
+        T old = *a.pointer();
+        *a.pointer() += inc;
+        return old;
+    }
+
+    template <SyncMode S = SyncMode::Blocking, GlobalCompletionEvent* C = &impl::local_gce, typename T, typename U>
+    void increment(GlobalAddress<T> a, U inc) { fetch_and_add(a, inc); }
+
+    template <SyncMode S = SyncMode::Blocking, GlobalCompletionEvent* C = &impl::local_gce, typename T, typename U, typename V>
+    bool compare_and_swap(GlobalAddress<T> a, U cmp, V val) {
+        std::lock_guard<std::mutex> g(shm::lock_for(a.pointer()));
+        if (!(*a.pointer() == cmp)) return false;
+        *a.pointer() = val;
+        return true;
+    }
+
+    template <SyncMode S = SyncMode::Blocking, GlobalCompletionEvent* C = &impl::local_gce, typename T, typename F>
+    auto call(GlobalAddress<T> a, F f) -> decltype(f(*a.pointer())) {
+        std::lock_guard<std::mutex> g(shm::lock_for(a.pointer()));
+        return f(*a.pointer());
+    }
+
+    template <SyncMode S = SyncMode::Blocking, GlobalCompletionEvent* C = &impl::local_gce, typename F>
+    auto call(Core c, F f) -> decltype(f()) {
+        return shm::as_core(c, f);
+    }
+
+} // namespace delegate
+
+// ---- messages -------------------------------------------------------------
+
+// Blocking forms: delivered before the send returns, so a payload may be reused at once.
+template <typename F>
+void send_message(Core dest, F f) { shm::as_core(dest, f); }
+
+template <typename F>
+void send_message(Core dest, F f, const void* payload, size_t size) {
+    shm::as_core(dest, [&]{ f(const_cast<void*>(payload), size); });
+}
+
+/**
+ * Queued and delivered later, by whichever core next runs tasks: one
+ * waiting on a CompletionEvent, finishing on_all_cores or idle. The
+ * payload is read only then, as Grappa's aggregator reads it only when the
+ * message goes out: the caller keeps it alive and unchanged until the
+ * message has been delivered.
+ */
+template <typename F>
+void send_heap_message(Core dest, F f, void* payload, size_t size) {
+    shm::pool.messages++;
+    shm::push(dest, shm::Task{ [dest, f, payload, size]{
+        shm::as_core(dest, [&]{ f(payload, size); });
+    }, &shm::pool.messages });
+}
+
+// ---- collectives ----------------------------------------------------------
+
+template <typename T> T collective_add(const T& a, const T& b) { return a + b; }
+template <typename T> T collective_max(const T& a, const T& b) { return a < b ? b : a; }
+template <typename T> T collective_min(const T& a, const T& b) { return b < a ? b : a; }
+template <typename T> T collective_or(const T& a, const T& b)  { return a | b; }
+template <typename T> T collective_and(const T& a, const T& b) { return a & b; }
+
+// Must be called by every core inside on_all_cores, like the real thing.
+template <typename T, T (*ReduceOp)(const T&, const T&)>
+T allreduce(T myval) {
+    static std::vector<T> slots;
+    if (mycore() == 0) slots.assign(cores(), T());
+    barrier();
+    slots[mycore()] = myval;
+    barrier();
+    T total = slots[0];
+    for (int c = 1; c < cores(); c++) total = ReduceOp(total, slots[c]);
+    barrier();
+    return total;
+}
+
+} // namespace Grappa
+
+DECLARE_int64(shm_cores);
+
+namespace Grappa {
+
+// ---- lifecycle ------------------------------------------------------------
+
+inline void init(int* argc, char*** argv) {
+    shm::parse_flags(argc, argv);
+    int64_t n = FLAGS_shm_cores > 0 ? FLAGS_shm_cores : (int64_t)std::thread::hardware_concurrency();
+    shm::start((int)n);
+}
+
+template <typename F>
+void run(F f) { f(); }
+
+inline void finalize() { shm::stop(); }
+
+} // namespace Grappa
+
+// Definitions for the single translation unit each program is built from.
+namespace Grappa {
+namespace shm {
+    int32_t verbosity = 0;
+    Pool pool;
+    thread_local Core current_core = 0;
+    static FlagRegistration shm_flag_v("v", &verbosity, "verbose logging level");
+}
+namespace impl { GlobalCompletionEvent local_gce; }
+}
+DEFINE_int64(shm_cores, 0, "number of worker threads (0 = one per hardware thread)");